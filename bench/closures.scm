@@ -0,0 +1,34 @@
+;; Higher-order list processing: map and fold with closures that capture
+;; their environment, and composition building new closures per iteration.
+
+(define (map f lst)
+  (if (null? lst)
+      '()
+      (cons (f (car lst)) (map f (cdr lst)))))
+
+(define (fold f acc lst)
+  (if (null? lst)
+      acc
+      (fold f (f acc (car lst)) (cdr lst))))
+
+(define (iota n)
+  (define (loop i acc)
+    (if (< i 0)
+        acc
+        (loop (- i 1) (cons i acc))))
+  (loop (- n 1) '()))
+
+(define (compose f g) (lambda (x) (f (g x))))
+
+(define (adder k) (lambda (x) (+ x k)))
+
+(define numbers (iota 1000))
+
+(define (round-trip n acc)
+  (if (= n 0)
+      acc
+      (let ((step (compose (adder n) (lambda (x) (* x 2)))))
+        (round-trip (- n 1)
+                    (+ acc (fold (lambda (s x) (+ s x)) 0 (map step numbers)))))))
+
+(round-trip 200 0)
@@ -0,0 +1,27 @@
+;; Symbolic differentiation: builds and walks lists of quoted symbols, so the
+;; time is dominated by eq? on symbols, quote and variable lookup.
+
+(define (deriv e x)
+  (cond ((number? e) 0)
+        ((symbol? e) (if (eq? e x) 1 0))
+        ((eq? (car e) '+)
+         (list '+ (deriv (car (cdr e)) x) (deriv (car (cdr (cdr e))) x)))
+        ((eq? (car e) '*)
+         (list '+
+               (list '* (car (cdr e)) (deriv (car (cdr (cdr e))) x))
+               (list '* (deriv (car (cdr e)) x) (car (cdr (cdr e))))))
+        (else 'unknown)))
+
+(define poly
+  '(+ (* 3 (* x (* x x)))
+      (+ (* a (* x x))
+         (+ (* b x)
+            (+ (* c (* x (* y z)))
+               (* (+ x y) (+ x (* 2 z))))))))
+
+(define (repeat n)
+  (if (= n 0)
+      (deriv poly 'x)
+      (begin (deriv poly 'x) (repeat (- n 1)))))
+
+(repeat 3000)
@@ -0,0 +1,62 @@
+/**
+ * @file lookup_bench.cpp
+ * @brief Microbenchmark: variable lookup cost against environment size
+ *
+ * Defines N globals and times a reference to the oldest one. "list walk" is
+ * the by-name search of an association list holding the same bindings, which
+ * is how globals used to be stored; "table" is a lookup in the global hash
+ * table; "resolved" is a Var after the lexical addressing pass, which reaches
+ * the binding through its cached cell.
+ */
+
+#include "value.hpp"
+#include "expr.hpp"
+#include "resolve.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Runs f until at least 50ms have passed and returns nanoseconds per call
+template <typename F>
+static double nsPerCall(F f) {
+    using clock = std::chrono::steady_clock;
+    long calls = 0;
+    auto start = clock::now();
+    double elapsed = 0;
+    do {
+        for (int i = 0; i < 1000; ++i) {
+            f();
+        }
+        calls += 1000;
+        elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    } while (elapsed < 5e7);
+    return elapsed / calls;
+}
+
+int main() {
+    std::printf("%10s %15s %12s %14s\n", "bindings", "list walk (ns)", "table (ns)", "resolved (ns)");
+    int defined = 0;
+    for (int n : {1, 10, 100, 1000, 10000}) {
+        Assoc chain = empty();
+        for (int i = 0; i < n; ++i) {
+            chain = extend(intern("g" + std::to_string(i)), IntegerV(i), chain);
+        }
+        for (; defined < n; ++defined) {
+            defineGlobal(intern("g" + std::to_string(defined)), IntegerV(defined));
+        }
+
+        volatile ValueBase *sink = nullptr;
+        Sym g0 = intern("g0");
+        double by_name = nsPerCall([&] { sink = find(g0, chain).get(); });
+        double hashed = nsPerCall([&] { sink = findGlobal(g0)->get(); });
+
+        Expr var(new Var(g0));
+        resolve(var);
+        Env top_env;
+        double resolved = nsPerCall([&] { sink = var->eval(top_env).get(); });
+
+        std::printf("%10d %15.1f %12.1f %14.1f\n", n, by_name, hashed, resolved);
+        (void)sink;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+;; Counts the solutions of the 8 queens problem by backtracking over lists.
+
+(define (ok? row dist placed)
+  (if (null? placed)
+      #t
+      (and (not (= (car placed) (+ row dist)))
+           (not (= (car placed) (- row dist)))
+           (not (= (car placed) row))
+           (ok? row (+ dist 1) (cdr placed)))))
+
+(define (try-rows candidates rest placed)
+  (if (null? candidates)
+      0
+      (+ (if (ok? (car candidates) 1 placed)
+             (queens (append-rows rest (cdr candidates)) (cons (car candidates) placed))
+             0)
+         (try-rows (cdr candidates) (cons (car candidates) rest) placed))))
+
+(define (append-rows a b)
+  (if (null? a)
+      b
+      (cons (car a) (append-rows (cdr a) b))))
+
+(define (queens remaining placed)
+  (if (null? remaining)
+      1
+      (try-rows remaining '() placed)))
+
+(define (count-to n)
+  (if (= n 0)
+      '()
+      (cons n (count-to (- n 1)))))
+
+(queens (count-to 8) '())
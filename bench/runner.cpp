@@ -0,0 +1,268 @@
+/**
+ * @file runner.cpp
+ * @brief Runs the benchmark programs and compares them with a baseline
+ *
+ * Each .scm file in the bench directory is run several times as
+ * `code --gc-stats FILE`. The runner keeps the median wall time, and reads
+ * the object allocation count and the deepest stack at an allocation from the
+ * statistics line on stderr of the last run. The count is exact; the stack
+ * depth moves by a few kilobytes with the process environment. The results
+ * are printed next to the baseline file's figures and written as a JSON
+ * report in the baseline's format, so a report can be checked in as the next
+ * baseline.
+ *
+ * Usage: bench_runner [--code PATH] [--vm] [--runs N] [--baseline FILE]
+ *                     [--report FILE] [--update-baseline] [PROGRAM.scm...]
+ * With no programs every .scm file in the bench directory is run.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#ifndef BENCH_DIR
+#define BENCH_DIR "bench"
+#endif
+#ifndef CODE_PATH
+#define CODE_PATH "code"
+#endif
+
+struct Result {
+    double median_ms;
+    unsigned long long allocations;
+    unsigned long long max_stack_bytes;
+    bool ok;            ///< Every run exited normally
+};
+
+struct Options {
+    std::string code;
+    bool vm;
+    int runs;
+    std::string baseline;
+    std::string report;
+    bool update_baseline;
+    std::vector<std::string> programs;
+};
+
+static std::string programName(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    std::string file = slash == std::string::npos ? path : path.substr(slash + 1);
+    return file.substr(0, file.rfind('.'));
+}
+
+static std::vector<std::string> listPrograms(const std::string &dir) {
+    std::vector<std::string> programs;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return programs;
+    }
+    while (dirent *e = readdir(d)) {
+        std::string file = e->d_name;
+        if (file.size() > 4 && file.compare(file.size() - 4, 4, ".scm") == 0) {
+            programs.push_back(dir + "/" + file);
+        }
+    }
+    closedir(d);
+    std::sort(programs.begin(), programs.end());
+    return programs;
+}
+
+// Runs the program once; returns false if it could not be started or did not exit cleanly
+static bool runOnce(const Options &opt, const std::string &program, double &ms, std::string &stats) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 2);
+
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(opt.code.c_str()));
+    argv.push_back(const_cast<char *>("--gc-stats"));
+    if (opt.vm) argv.push_back(const_cast<char *>("--vm"));
+    argv.push_back(const_cast<char *>(program.c_str()));
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    int err = posix_spawn(&pid, opt.code.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        return false;
+    }
+    stats.clear();
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof buf)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        stats.append(buf, n);
+    }
+    close(fds[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The number just before a phrase of the --gc-stats line
+static unsigned long long statBefore(const std::string &stats, const char *phrase) {
+    size_t at = stats.find(phrase);
+    if (at == std::string::npos) return 0;
+    size_t begin = at;
+    while (begin > 0 && stats[begin - 1] == ' ') --begin;
+    while (begin > 0 && isdigit((unsigned char)stats[begin - 1])) --begin;
+    return strtoull(stats.c_str() + begin, nullptr, 10);
+}
+
+static Result measure(const Options &opt, const std::string &program) {
+    Result r = {0, 0, 0, true};
+    std::vector<double> times;
+    std::string stats;
+    for (int i = 0; i < opt.runs; ++i) {
+        double ms = 0;
+        if (!runOnce(opt, program, ms, stats)) {
+            r.ok = false;
+            return r;
+        }
+        times.push_back(ms);
+    }
+    std::sort(times.begin(), times.end());
+    r.median_ms = times.size() % 2 ? times[times.size() / 2]
+                                   : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+    r.allocations = statBefore(stats, "objects (");
+    r.max_stack_bytes = statBefore(stats, "bytes of stack");
+    return r;
+}
+
+// Reads the lines a report writes for each program; anything else in the file is skipped
+static std::map<std::string, Result> readBaseline(const std::string &path) {
+    std::map<std::string, Result> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        char name[256];
+        Result r = {0, 0, 0, true};
+        if (sscanf(line.c_str(), " \"%255[^\"]\": {\"median_ms\": %lf, \"allocations\": %llu, \"max_stack_bytes\": %llu",
+                   name, &r.median_ms, &r.allocations, &r.max_stack_bytes) == 4) {
+            baseline[name] = r;
+        }
+    }
+    return baseline;
+}
+
+static void writeReport(const std::string &path, const Options &opt,
+                        const std::vector<std::pair<std::string, Result>> &results) {
+    std::ofstream out(path);
+    out << "{\n"
+        << "  \"vm\": " << (opt.vm ? "true" : "false") << ",\n"
+        << "  \"runs\": " << opt.runs << ",\n"
+        << "  \"programs\": {\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i].second;
+        char line[512];
+        snprintf(line, sizeof line, "    \"%s\": {\"median_ms\": %.1f, \"allocations\": %llu, \"max_stack_bytes\": %llu}%s\n",
+                 results[i].first.c_str(), r.median_ms, r.allocations, r.max_stack_bytes,
+                 i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  }\n}\n";
+}
+
+static bool parseOptions(int argc, char *argv[], Options &opt) {
+    opt.code = CODE_PATH;
+    opt.vm = false;
+    opt.runs = 5;
+    opt.baseline = std::string(BENCH_DIR) + "/baseline.json";
+    opt.report = "bench_report.json";
+    opt.update_baseline = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--vm") {
+            opt.vm = true;
+        } else if (a == "--update-baseline") {
+            opt.update_baseline = true;
+        } else if (a == "--code" && has_value) {
+            opt.code = argv[++i];
+        } else if (a == "--runs" && has_value) {
+            opt.runs = std::max(1, atoi(argv[++i]));
+        } else if (a == "--baseline" && has_value) {
+            opt.baseline = argv[++i];
+        } else if (a == "--report" && has_value) {
+            opt.report = argv[++i];
+        } else if (!a.empty() && a[0] == '-') {
+            std::cerr << "unknown option " << a << std::endl;
+            return false;
+        } else {
+            opt.programs.push_back(a);
+        }
+    }
+    if (opt.programs.empty()) {
+        opt.programs = listPrograms(BENCH_DIR);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        return 2;
+    }
+    std::map<std::string, Result> baseline = readBaseline(opt.baseline);
+
+    printf("%-12s %12s %12s %8s %14s %14s %12s\n", "program", "median (ms)", "baseline", "ratio",
+           "allocations", "baseline", "stack (B)");
+    std::vector<std::pair<std::string, Result>> results;
+    bool failed = false;
+    for (const std::string &program : opt.programs) {
+        std::string name = programName(program);
+        Result r = measure(opt, program);
+        if (!r.ok) {
+            printf("%-12s failed\n", name.c_str());
+            failed = true;
+            continue;
+        }
+        results.push_back(std::make_pair(name, r));
+        auto base = baseline.find(name);
+        if (base == baseline.end()) {
+            printf("%-12s %12.1f %12s %8s %14llu %14s %12llu\n", name.c_str(), r.median_ms, "-", "-",
+                   r.allocations, "-", r.max_stack_bytes);
+        } else {
+            const Result &b = base->second;
+            printf("%-12s %12.1f %12.1f %7.2fx %14llu %14llu %12llu\n", name.c_str(), r.median_ms, b.median_ms,
+                   b.median_ms > 0 ? r.median_ms / b.median_ms : 0.0, r.allocations, b.allocations,
+                   r.max_stack_bytes);
+        }
+        fflush(stdout);
+    }
+
+    writeReport(opt.report, opt, results);
+    if (opt.update_baseline) {
+        writeReport(opt.baseline, opt, results);
+        printf("baseline %s updated\n", opt.baseline.c_str());
+    }
+    return failed ? 1 : 0;
+}
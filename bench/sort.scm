@@ -0,0 +1,38 @@
+;; Merge sort of pseudo-random lists: allocation of pairs and list traversal.
+
+(define (random-list n seed)
+  (if (= n 0)
+      '()
+      (cons seed (random-list (- n 1) (modulo (+ (* seed 1103515245) 12345) 2147483648)))))
+
+(define (split lst)
+  (if (or (null? lst) (null? (cdr lst)))
+      (cons lst '())
+      (let ((rest (split (cdr (cdr lst)))))
+        (cons (cons (car lst) (car rest))
+              (cons (car (cdr lst)) (cdr rest))))))
+
+(define (merge a b)
+  (cond ((null? a) b)
+        ((null? b) a)
+        ((< (car a) (car b)) (cons (car a) (merge (cdr a) b)))
+        (else (cons (car b) (merge a (cdr b))))))
+
+(define (sort lst)
+  (if (or (null? lst) (null? (cdr lst)))
+      lst
+      (let ((halves (split lst)))
+        (merge (sort (car halves)) (sort (cdr halves))))))
+
+(define (sorted? lst)
+  (or (null? lst)
+      (null? (cdr lst))
+      (and (not (< (car (cdr lst)) (car lst)))
+           (sorted? (cdr lst)))))
+
+(define (repeat n ok)
+  (if (= n 0)
+      ok
+      (repeat (- n 1) (and ok (sorted? (sort (random-list 2000 n)))))))
+
+(repeat 20 #t)
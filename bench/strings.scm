@@ -0,0 +1,17 @@
+;; The interpreter has no string operations beyond display, so text is built
+;; by writing it: many short strings, numbers and lists go through the output
+;; writer and the value printer.
+
+(define (line i)
+  (display "item ")
+  (display i)
+  (display ": ")
+  (display (list i "label" 'tag (/ i 7)))
+  (display "\n"))
+
+(define (lines i n)
+  (if (= i n)
+      (void)
+      (begin (line i) (lines (+ i 1) n))))
+
+(lines 0 30000)
@@ -0,0 +1,327 @@
+/**
+ * @file runner.cpp
+ * @brief Runs the score cases in parallel and reports results and costs
+ *
+ * Every .in file under the case directories is run as a script by the
+ * interpreter (code FILE, so no prompts are printed) with its output captured
+ * through a pipe. When a matching .out file exists the output is compared
+ * with it as `diff -b` would: runs of whitespace compare equal and trailing
+ * whitespace is ignored. Wall time and peak resident set size of each run are
+ * written to a JSON report along with the verdict.
+ *
+ * Usage: score_runner [--code PATH] [--vm] [--jobs N] [--timeout SECONDS]
+ *                     [--report FILE] [DIR...]
+ * With no DIR the score/data and score/more-tests directories are used.
+ * The exit status is 1 if any case failed, crashed or timed out.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#ifndef SCORE_DIR
+#define SCORE_DIR "score"
+#endif
+#ifndef CODE_PATH
+#define CODE_PATH "code"
+#endif
+
+enum Verdict { PASS, FAIL, UNCHECKED, CRASH, TIMEOUT };
+
+static const char *verdictName(Verdict v) {
+    static const char *names[] = {"pass", "fail", "unchecked", "crash", "timeout"};
+    return names[v];
+}
+
+struct Case {
+    std::string name;       ///< Path of the .in file relative to the score directory, for the report
+    std::string input;
+    std::string expected;   ///< Path of the .out file, empty when there is none
+    Verdict verdict;
+    double wall_ms;
+    long peak_rss_kb;
+};
+
+struct Options {
+    std::string code;
+    bool vm;
+    unsigned jobs;
+    double timeout_s;
+    std::string report;
+    std::vector<std::string> dirs;
+};
+
+static bool exists(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static bool readFile(const std::string &path, std::string &text) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+// Numeric order, so 2.in comes before 10.in
+static bool caseOrder(const Case &a, const Case &b) {
+    if (a.name.size() != b.name.size()) {
+        size_t da = a.name.rfind('/'), db = b.name.rfind('/');
+        std::string dir_a = a.name.substr(0, da), dir_b = b.name.substr(0, db);
+        if (dir_a != dir_b) return dir_a < dir_b;
+        return a.name.size() < b.name.size();
+    }
+    return a.name < b.name;
+}
+
+static void collect(const std::string &dir, const std::string &label, std::vector<Case> &cases) {
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        std::cerr << "cannot read " << dir << std::endl;
+        return;
+    }
+    while (dirent *e = readdir(d)) {
+        std::string file = e->d_name;
+        if (file.size() < 4 || file.compare(file.size() - 3, 3, ".in") != 0) continue;
+        Case c;
+        c.name = label + "/" + file;
+        c.input = dir + "/" + file;
+        std::string out = dir + "/" + file.substr(0, file.size() - 3) + ".out";
+        c.expected = exists(out) ? out : "";
+        c.verdict = UNCHECKED;
+        c.wall_ms = 0;
+        c.peak_rss_kb = 0;
+        cases.push_back(c);
+    }
+    closedir(d);
+}
+
+// Splits into lines with whitespace runs collapsed and trailing whitespace dropped
+static std::vector<std::string> normalise(const std::string &text) {
+    std::vector<std::string> lines;
+    std::string line;
+    bool space = false;
+    for (char c : text) {
+        if (c == '\n') {
+            lines.push_back(line);
+            line.clear();
+            space = false;
+        } else if (isspace((unsigned char)c)) {
+            space = true;
+        } else {
+            if (space) line.push_back(' ');
+            space = false;
+            line.push_back(c);
+        }
+    }
+    if (!line.empty()) {
+        lines.push_back(line); // a last line without its newline
+    }
+    return lines;
+}
+
+static bool sameOutput(const std::string &actual, const std::string &expected) {
+    return normalise(actual) == normalise(expected);
+}
+
+static void run(Case &c, const Options &opt) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        c.verdict = CRASH;
+        return;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(opt.code.c_str()));
+    if (opt.vm) argv.push_back(const_cast<char *>("--vm"));
+    argv.push_back(const_cast<char *>(c.input.c_str()));
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    int err = posix_spawn(&pid, opt.code.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        c.verdict = CRASH;
+        return;
+    }
+
+    std::string output;
+    bool timed_out = false;
+    auto deadline = start + std::chrono::milliseconds((long long)(opt.timeout_s * 1000));
+    char buf[1 << 14];
+    while (true) {
+        long long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            timed_out = true;
+            break;
+        }
+        pollfd p = {fds[0], POLLIN, 0};
+        int r = poll(&p, 1, (int)std::min(left, 1000LL));
+        if (r < 0 && errno != EINTR) break;
+        if (r <= 0) continue;
+        ssize_t n = read(fds[0], buf, sizeof buf);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        output.append(buf, n);
+    }
+    close(fds[0]);
+    if (timed_out) kill(pid, SIGKILL);
+
+    int status = 0;
+    rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+    c.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    c.peak_rss_kb = usage.ru_maxrss;
+
+    std::string expected;
+    if (timed_out) {
+        c.verdict = TIMEOUT;
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        c.verdict = CRASH;
+    } else if (c.expected.empty() || !readFile(c.expected, expected)) {
+        c.verdict = UNCHECKED;
+    } else {
+        c.verdict = sameOutput(output, expected) ? PASS : FAIL;
+    }
+}
+
+static std::string jsonString(const std::string &s) {
+    std::string r = "\"";
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') r.push_back('\\');
+        r.push_back(ch);
+    }
+    return r + "\"";
+}
+
+static void writeReport(const std::string &path, const Options &opt, const std::vector<Case> &cases,
+                        double wall_ms, const int counts[]) {
+    std::ofstream out(path);
+    out << "{\n"
+        << "  \"code\": " << jsonString(opt.code) << ",\n"
+        << "  \"vm\": " << (opt.vm ? "true" : "false") << ",\n"
+        << "  \"jobs\": " << opt.jobs << ",\n"
+        << "  \"wall_ms\": " << wall_ms << ",\n";
+    for (int v = PASS; v <= TIMEOUT; ++v) {
+        out << "  \"" << verdictName((Verdict)v) << "\": " << counts[v] << ",\n";
+    }
+    out << "  \"cases\": [\n";
+    for (size_t i = 0; i < cases.size(); ++i) {
+        const Case &c = cases[i];
+        out << "    {\"name\": " << jsonString(c.name)
+            << ", \"status\": \"" << verdictName(c.verdict) << "\""
+            << ", \"wall_ms\": " << c.wall_ms
+            << ", \"peak_rss_kb\": " << c.peak_rss_kb << "}"
+            << (i + 1 < cases.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+static bool parseOptions(int argc, char *argv[], Options &opt) {
+    opt.code = CODE_PATH;
+    opt.vm = false;
+    opt.jobs = std::max(1u, std::thread::hardware_concurrency());
+    opt.timeout_s = 10;
+    opt.report = "score_report.json";
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--vm") {
+            opt.vm = true;
+        } else if (a == "--code" && has_value) {
+            opt.code = argv[++i];
+        } else if (a == "--jobs" && has_value) {
+            opt.jobs = std::max(1, atoi(argv[++i]));
+        } else if (a == "--timeout" && has_value) {
+            opt.timeout_s = atof(argv[++i]);
+        } else if (a == "--report" && has_value) {
+            opt.report = argv[++i];
+        } else if (!a.empty() && a[0] == '-') {
+            std::cerr << "unknown option " << a << std::endl;
+            return false;
+        } else {
+            opt.dirs.push_back(a);
+        }
+    }
+    if (opt.dirs.empty()) {
+        opt.dirs.push_back(std::string(SCORE_DIR) + "/data");
+        opt.dirs.push_back(std::string(SCORE_DIR) + "/more-tests");
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        return 2;
+    }
+
+    std::vector<Case> cases;
+    for (const std::string &dir : opt.dirs) {
+        std::string label = dir.substr(dir.find_last_of('/') + 1);
+        collect(dir, label, cases);
+    }
+    std::sort(cases.begin(), cases.end(), caseOrder);
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < opt.jobs; ++i) {
+        workers.emplace_back([&]() {
+            for (size_t k = next++; k < cases.size(); k = next++) {
+                run(cases[k], opt);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    int counts[TIMEOUT + 1] = {0};
+    for (const Case &c : cases) {
+        ++counts[c.verdict];
+        if (c.verdict == FAIL || c.verdict == CRASH || c.verdict == TIMEOUT) {
+            std::cout << verdictName(c.verdict) << ": " << c.name << std::endl;
+        }
+    }
+    writeReport(opt.report, opt, cases, wall_ms, counts);
+    std::cout << cases.size() << " cases in " << wall_ms << " ms on " << opt.jobs << " jobs: "
+              << counts[PASS] << " passed, " << counts[FAIL] << " failed, "
+              << counts[UNCHECKED] << " without expected output, "
+              << counts[CRASH] << " crashed, " << counts[TIMEOUT] << " timed out; report in "
+              << opt.report << std::endl;
+    return counts[FAIL] + counts[CRASH] + counts[TIMEOUT] == 0 ? 0 : 1;
+}
@@ -8,6 +8,7 @@
  */
 
 #include "Def.hpp"
+#include <unordered_set>
 
 /**
  * @brief Mapping of primitive function names to expression types
@@ -67,10 +68,14 @@ std::map<std::string, ExprType> primitives = {
     
     // I/O operations
     {"display",   E_DISPLAY},
+    {"flush-output", E_FLUSH},
     
     // Special values and control
     {"void",      E_VOID},
-    {"exit",      E_EXIT}
+    {"exit",      E_EXIT},
+
+    // Introspection
+    {"runtime-stats", E_RUNTIME_STATS}
 };
 
 /**
@@ -113,3 +118,14 @@ std::map<std::string, ExprType> reserved_words = {
     // Assignment
     {"set!",    E_SET}      
 };
+
+/**
+ * @brief Returns the unique Sym for a spelling
+ *
+ * Elements of an unordered_set never move, so the address of the stored
+ * string identifies the symbol for the rest of the run.
+ */
+Sym intern(const std::string &s) {
+    static std::unordered_set<std::string> table;
+    return Sym(&*table.insert(s).first);
+}
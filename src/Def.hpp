@@ -15,13 +15,19 @@
 #include <vector>
 #include <iostream>
 #include <map>
+#include <functional>
 
 // Forward declarations
 struct Syntax;
-struct Expr;
-struct Value;
+struct ExprBase;
+class Value;
 struct AssocList;
 struct Assoc;
+struct Scope;
+struct Compiler;
+struct Chunk;
+struct Frame;
+struct Env;
 
 /**
  * @brief Expression types enumeration
@@ -32,6 +38,7 @@ struct Assoc;
 enum ExprType {
     // Basic types and literals
     E_FIXNUM,          
+    E_BIGNUM,
     E_RATIONAL,        
     E_STRING,         
     E_TRUE,            
@@ -101,6 +108,10 @@ enum ExprType {
 
     // I/O operations
     E_DISPLAY,         
+    E_FLUSH,
+
+    // Introspection
+    E_RUNTIME_STATS,
 };
 
 /**
@@ -111,16 +122,61 @@ enum ExprType {
  */
 enum ValueType {
     V_INT,              
+    V_BIGINT,
     V_RATIONAL,         
+    V_BIGRATIONAL,
     V_BOOL,             
     V_SYM,              
     V_NULL,             
     V_STRING,           
     V_PAIR,             
     V_PROC,             
+    V_PRIMITIVE,
+    V_BOX,
     V_VOID,            
     V_TERMINATE,
     V_VOID_DEFINE
 };
 
+/**
+ * @brief Interned symbol name
+ *
+ * intern() returns the same Sym for equal spellings, so comparing two Syms
+ * compares one pointer and copying one never copies the characters. The
+ * reader interns every identifier; from then on variables, parameters,
+ * environments and symbol values all carry Syms.
+ */
+class Sym {
+    const std::string *p;
+    explicit Sym(const std::string *p) : p(p) {}
+    friend Sym intern(const std::string &);
+public:
+    Sym() : p(nullptr) {}
+    const std::string &str() const { return *p; }
+    bool operator==(const Sym &other) const { return p == other.p; }
+    bool operator!=(const Sym &other) const { return p != other.p; }
+    size_t hash() const { return std::hash<const std::string *>()(p); }
+};
+
+Sym intern(const std::string &);
+
+/**
+ * @brief Handle to an expression node; the node itself lives in an arena
+ */
+class Expr {
+    ExprBase *ptr;
+public:
+    Expr(ExprBase *);
+    ExprBase* operator->() const;
+    ExprBase& operator*();
+    ExprBase* get() const;
+};
+
+namespace std {
+template <>
+struct hash<Sym> {
+    size_t operator()(const Sym &s) const { return s.hash(); }
+};
+}
+
 #endif // DEF_HPP
@@ -1,5 +1,8 @@
 #include "RE.hpp"
+#include "stats.hpp"
 #include <cstring>
 
-RuntimeError::RuntimeError(std::string s1) : s(s1) {}
+RuntimeError::RuntimeError(std::string s1) : s(s1) {
+    ++runtime_stats.errors;
+}
 std::string RuntimeError::message() const { return s; }
\ No newline at end of file
@@ -0,0 +1,82 @@
+/**
+ * @file arena.cpp
+ * @brief Implementation of the syntax and expression arenas
+ */
+
+#include "arena.hpp"
+#include <algorithm>
+#include <new>
+
+// Blocks double from the first size up to the last, so a small retained form keeps little memory
+static const size_t FIRST_BLOCK_BYTES = 1 << 10;
+static const size_t BLOCK_BYTES = 16 << 10;
+static const size_t ARENA_ALIGN = alignof(std::max_align_t);
+
+Arena::Arena() : next(nullptr), end(nullptr), block_bytes(0), keep(false) {}
+
+Arena::~Arena() {
+    for (size_t i = objects.size(); i-- > 0;) {
+        objects[i].destroy(objects[i].p);
+    }
+    for (char *block : blocks) {
+        ::operator delete(block);
+    }
+}
+
+void *Arena::allocate(size_t size, void (*destroy)(void *)) {
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    char *p;
+    if (size > BLOCK_BYTES / 2) {
+        p = static_cast<char *>(::operator new(size));
+        blocks.push_back(p);
+    } else {
+        if (next == nullptr || size > (size_t)(end - next)) {
+            block_bytes = block_bytes == 0 ? FIRST_BLOCK_BYTES : std::min(2 * block_bytes, BLOCK_BYTES);
+            block_bytes = std::max(block_bytes, size);
+            next = static_cast<char *>(::operator new(block_bytes));
+            end = next + block_bytes;
+            blocks.push_back(next);
+        }
+        p = next;
+        next += size;
+    }
+    objects.push_back(Object{p, destroy});
+    return p;
+}
+
+void Arena::forget(void *p) {
+    for (size_t i = objects.size(); i-- > 0;) {
+        if (objects[i].p == p) {
+            objects.erase(objects.begin() + i);
+            return;
+        }
+    }
+}
+
+void Arena::adopt(Arena &other) {
+    blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+    objects.insert(objects.end(), other.objects.begin(), other.objects.end());
+    other.blocks.clear();
+    other.objects.clear();
+    other.next = other.end = nullptr;
+    other.block_bytes = 0;
+}
+
+Arena &codeArena() {
+    static Arena *code = new Arena(); // outlives every static that may point into it
+    return *code;
+}
+
+static Arena *current = nullptr;
+
+Arena &currentArena() {
+    return current != nullptr ? *current : codeArena();
+}
+
+ArenaScope::ArenaScope(Arena &arena) : saved(current) {
+    current = &arena;
+}
+
+ArenaScope::~ArenaScope() {
+    current = saved;
+}
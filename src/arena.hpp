@@ -0,0 +1,61 @@
+#ifndef ARENA
+#define ARENA
+
+/**
+ * @file arena.hpp
+ * @brief Region allocation for syntax and expression trees
+ *
+ * SyntaxBase and ExprBase objects are placed in the current arena rather than
+ * allocated one by one, and Syntax and Expr are plain pointers into it. The
+ * REPL reads, parses and runs each top-level form inside an arena of its own
+ * and drops the whole region afterwards. A form that built a lambda may have
+ * left procedures pointing into its body, so its arena is retained: adopted
+ * by the code arena, which lives for the rest of the program.
+ */
+
+#include <cstddef>
+#include <vector>
+
+class Arena {
+public:
+    Arena();
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * @brief Returns uninitialised storage; destroy is run on it when the arena goes
+     */
+    void *allocate(size_t, void (*destroy)(void *));
+    void forget(void *);        ///< Drops an object whose constructor threw
+
+    void retain() { keep = true; }              ///< Something built here outlives the form
+    bool retained() const { return keep; }
+    void adopt(Arena &);        ///< Takes over the memory and objects of another arena
+
+private:
+    struct Object {
+        void *p;
+        void (*destroy)(void *);
+    };
+    std::vector<char *> blocks;
+    char *next;
+    char *end;
+    size_t block_bytes;         ///< Size of the block being bumped, 0 before the first
+    std::vector<Object> objects; ///< In allocation order, destroyed in reverse
+    bool keep;
+};
+
+Arena &codeArena();             ///< Never freed; the current arena outside any ArenaScope
+Arena &currentArena();
+
+/**
+ * @brief Makes an arena current for as long as the scope object exists
+ */
+struct ArenaScope {
+    Arena *saved;
+    explicit ArenaScope(Arena &);
+    ~ArenaScope();
+};
+
+#endif
@@ -0,0 +1,374 @@
+/**
+ * @file bigint.cpp
+ * @brief Implementation of arbitrary-precision integers
+ */
+
+#include "bigint.hpp"
+#include <algorithm>
+#include <climits>
+
+// Below this many limbs in either operand, schoolbook multiplication is faster
+static const size_t KARATSUBA_THRESHOLD = 32;
+
+BigInt::BigInt() : neg(false) {}
+
+BigInt::BigInt(long long n) : neg(n < 0) {
+    // negate in unsigned arithmetic so LLONG_MIN is well defined
+    unsigned long long m = neg ? 0ULL - (unsigned long long)n : (unsigned long long)n;
+    while (m != 0) {
+        mag.push_back((uint32_t)m);
+        m >>= 32;
+    }
+}
+
+BigInt::BigInt(const std::string &digits) : neg(false) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < digits.size() && (digits[i] == '+' || digits[i] == '-')) {
+        negative = digits[i] == '-';
+        ++i;
+    }
+    // nine decimal digits at a time: multiply by 10^k and add the chunk
+    while (i < digits.size()) {
+        size_t len = std::min<size_t>(9, digits.size() - i);
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for (size_t k = 0; k < len; ++k) {
+            chunk = chunk * 10 + (digits[i + k] - '0');
+            scale *= 10;
+        }
+        uint64_t carry = chunk;
+        for (uint32_t &limb : mag) {
+            uint64_t t = (uint64_t)limb * scale + carry;
+            limb = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry != 0) {
+            mag.push_back((uint32_t)carry);
+        }
+        i += len;
+    }
+    trim(mag);
+    neg = negative && !mag.empty();
+}
+
+BigInt::BigInt(bool negative, Mag m) : neg(false), mag(std::move(m)) {
+    trim(mag);
+    neg = negative && !mag.empty();
+}
+
+void BigInt::trim(Mag &m) {
+    while (!m.empty() && m.back() == 0) {
+        m.pop_back();
+    }
+}
+
+bool BigInt::fitsInt() const {
+    if (mag.size() > 1) {
+        return false;
+    }
+    if (mag.empty()) {
+        return true;
+    }
+    return neg ? mag[0] <= (uint32_t)INT_MAX + 1 : mag[0] <= (uint32_t)INT_MAX;
+}
+
+int BigInt::toInt() const {
+    if (mag.empty()) {
+        return 0;
+    }
+    return neg ? (int)(0U - mag[0]) : (int)mag[0];
+}
+
+bool BigInt::fitsLongLong() const {
+    if (mag.size() > 2) {
+        return false;
+    }
+    uint64_t m = 0;
+    for (size_t i = mag.size(); i-- > 0;) {
+        m = (m << 32) | mag[i];
+    }
+    return m <= (uint64_t)LLONG_MAX;
+}
+
+long long BigInt::toLongLong() const {
+    uint64_t m = 0;
+    for (size_t i = mag.size(); i-- > 0;) {
+        m = (m << 32) | mag[i];
+    }
+    return neg ? -(long long)m : (long long)m;
+}
+
+std::string BigInt::toString() const {
+    if (mag.empty()) {
+        return "0";
+    }
+    // peel off nine decimal digits per division, least significant first
+    std::vector<uint32_t> chunks;
+    Mag m = mag;
+    while (!m.empty()) {
+        uint64_t rem = 0;
+        for (size_t i = m.size(); i-- > 0;) {
+            uint64_t cur = (rem << 32) | m[i];
+            m[i] = (uint32_t)(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        trim(m);
+        chunks.push_back((uint32_t)rem);
+    }
+    std::string s = neg ? "-" : "";
+    s += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string part = std::to_string(chunks[i]);
+        s.append(9 - part.size(), '0');
+        s += part;
+    }
+    return s;
+}
+
+// ============================================================================
+// Magnitude arithmetic
+// ============================================================================
+
+int BigInt::compareMag(const Mag &a, const Mag &b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+BigInt::Mag BigInt::addMag(const Mag &a, const Mag &b) {
+    const Mag &longer = a.size() >= b.size() ? a : b;
+    const Mag &shorter = a.size() >= b.size() ? b : a;
+    Mag sum(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        uint64_t t = (uint64_t)longer[i] + (i < shorter.size() ? shorter[i] : 0) + carry;
+        sum[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    sum[longer.size()] = (uint32_t)carry;
+    trim(sum);
+    return sum;
+}
+
+BigInt::Mag BigInt::subMag(const Mag &a, const Mag &b) {
+    Mag diff(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int64_t t = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = t < 0;
+        diff[i] = (uint32_t)(t + (borrow << 32));
+    }
+    trim(diff);
+    return diff;
+}
+
+// Adds x, shifted up by the given number of limbs, into acc; acc must be long enough
+static void addShifted(std::vector<uint32_t> &acc, const std::vector<uint32_t> &x, size_t shift) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < x.size(); ++i) {
+        uint64_t t = (uint64_t)acc[i + shift] + x[i] + carry;
+        acc[i + shift] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    for (size_t k = i + shift; carry != 0 && k < acc.size(); ++k) {
+        uint64_t t = (uint64_t)acc[k] + carry;
+        acc[k] = (uint32_t)t;
+        carry = t >> 32;
+    }
+}
+
+BigInt::Mag BigInt::mulMag(const Mag &a, const Mag &b) {
+    if (a.empty() || b.empty()) {
+        return Mag();
+    }
+    if (a.size() >= KARATSUBA_THRESHOLD && b.size() >= KARATSUBA_THRESHOLD) {
+        return karatsuba(a, b);
+    }
+    Mag product(a.size() + b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); ++j) {
+            uint64_t t = (uint64_t)a[i] * b[j] + product[i + j] + carry;
+            product[i + j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        product[i + b.size()] = (uint32_t)carry;
+    }
+    trim(product);
+    return product;
+}
+
+// a * b = z2 B^2m + z1 B^m + z0 with z1 = (a0 + a1)(b0 + b1) - z2 - z0: three half-size products
+BigInt::Mag BigInt::karatsuba(const Mag &a, const Mag &b) {
+    size_t m = std::max(a.size(), b.size()) / 2;
+    auto low = [m](const Mag &x) {
+        Mag part(x.begin(), x.begin() + std::min(m, x.size()));
+        trim(part);
+        return part;
+    };
+    auto high = [m](const Mag &x) {
+        return x.size() > m ? Mag(x.begin() + m, x.end()) : Mag();
+    };
+    Mag a0 = low(a), a1 = high(a);
+    Mag b0 = low(b), b1 = high(b);
+
+    Mag z0 = mulMag(a0, b0);
+    Mag z2 = mulMag(a1, b1);
+    Mag z1 = mulMag(addMag(a0, a1), addMag(b0, b1));
+    z1 = subMag(subMag(z1, z2), z0);
+
+    Mag product(a.size() + b.size() + 1);
+    addShifted(product, z0, 0);
+    addShifted(product, z1, m);
+    addShifted(product, z2, 2 * m);
+    trim(product);
+    return product;
+}
+
+// Knuth's algorithm D on 32-bit limbs, after Hacker's Delight divmnu
+void BigInt::divModMag(const Mag &u, const Mag &v, Mag &q, Mag &r) {
+    if (compareMag(u, v) < 0) {
+        q.clear();
+        r = u;
+        return;
+    }
+    if (v.size() == 1) {
+        q.assign(u.size(), 0);
+        uint64_t rem = 0;
+        for (size_t i = u.size(); i-- > 0;) {
+            uint64_t cur = (rem << 32) | u[i];
+            q[i] = (uint32_t)(cur / v[0]);
+            rem = cur % v[0];
+        }
+        trim(q);
+        r.assign(1, (uint32_t)rem);
+        trim(r);
+        return;
+    }
+
+    // normalise so the divisor's top limb has its high bit set
+    size_t n = v.size();
+    size_t m = u.size() - n;
+    int s = __builtin_clz(v.back());
+    Mag vn(n), un(u.size() + 1);
+    for (size_t i = n - 1; i > 0; --i) {
+        vn[i] = (v[i] << s) | (s ? (uint32_t)((uint64_t)v[i - 1] >> (32 - s)) : 0);
+    }
+    vn[0] = v[0] << s;
+    un[u.size()] = s ? (uint32_t)((uint64_t)u.back() >> (32 - s)) : 0;
+    for (size_t i = u.size() - 1; i > 0; --i) {
+        un[i] = (u[i] << s) | (s ? (uint32_t)((uint64_t)u[i - 1] >> (32 - s)) : 0);
+    }
+    un[0] = u[0] << s;
+
+    const uint64_t base = (uint64_t)1 << 32;
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1];
+        uint64_t rhat = num % vn[n - 1];
+        while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            --qhat;
+            rhat += vn[n - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        int64_t k = 0;
+        int64_t t;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i + j] - k - (int64_t)(p & 0xFFFFFFFF);
+            un[i + j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + n] - k;
+        un[j + n] = (uint32_t)t;
+
+        q[j] = (uint32_t)qhat;
+        if (t < 0) { // qhat was one too large: add the divisor back
+            --q[j];
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t sum = (uint64_t)un[i + j] + vn[i] + carry;
+                un[i + j] = (uint32_t)sum;
+                carry = sum >> 32;
+            }
+            un[j + n] += (uint32_t)carry;
+        }
+    }
+    trim(q);
+
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = (un[i] >> s) | (s ? (uint32_t)((uint64_t)un[i + 1] << (32 - s)) : 0);
+    }
+    trim(r);
+}
+
+// ============================================================================
+// Signed arithmetic
+// ============================================================================
+
+BigInt BigInt::addSigned(bool na, const Mag &a, bool nb, const Mag &b) {
+    if (na == nb) {
+        return BigInt(na, addMag(a, b));
+    }
+    int c = compareMag(a, b);
+    if (c == 0) {
+        return BigInt();
+    }
+    return c > 0 ? BigInt(na, subMag(a, b)) : BigInt(nb, subMag(b, a));
+}
+
+BigInt BigInt::operator-() const {
+    return BigInt(!neg, mag);
+}
+
+BigInt operator+(const BigInt &a, const BigInt &b) {
+    return BigInt::addSigned(a.neg, a.mag, b.neg, b.mag);
+}
+
+BigInt operator-(const BigInt &a, const BigInt &b) {
+    return BigInt::addSigned(a.neg, a.mag, !b.neg, b.mag);
+}
+
+BigInt operator*(const BigInt &a, const BigInt &b) {
+    return BigInt(a.neg != b.neg, BigInt::mulMag(a.mag, b.mag));
+}
+
+int compare(const BigInt &a, const BigInt &b) {
+    if (a.neg != b.neg) {
+        return a.neg ? -1 : 1;
+    }
+    int c = BigInt::compareMag(a.mag, b.mag);
+    return a.neg ? -c : c;
+}
+
+void BigInt::divMod(const BigInt &a, const BigInt &b, BigInt &q, BigInt &r) {
+    Mag qm, rm;
+    divModMag(a.mag, b.mag, qm, rm);
+    q = BigInt(a.neg != b.neg, std::move(qm));
+    r = BigInt(a.neg, std::move(rm));
+}
+
+BigInt BigInt::gcd(BigInt a, BigInt b) {
+    a.neg = false;
+    b.neg = false;
+    while (!b.isZero()) {
+        BigInt q, r;
+        divMod(a, b, q, r);
+        a = std::move(b);
+        b = std::move(r);
+    }
+    return a;
+}
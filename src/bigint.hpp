@@ -0,0 +1,63 @@
+#ifndef BIGINT
+#define BIGINT
+
+/**
+ * @file bigint.hpp
+ * @brief Arbitrary-precision integers for exact arithmetic
+ *
+ * A BigInt is a sign and a magnitude of 32-bit limbs, least significant
+ * first, with no leading zero limbs; zero is the empty magnitude and is never
+ * negative. Multiplication switches from the schoolbook method to Karatsuba
+ * once both operands are long, and division is Knuth's algorithm D.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BigInt {
+public:
+    BigInt();
+    explicit BigInt(long long);
+    explicit BigInt(const std::string &);  ///< Decimal digits with an optional sign
+
+    bool isZero() const { return mag.empty(); }
+    bool negative() const { return neg; }
+    bool fitsInt() const;               ///< Within the range of a C int
+    int toInt() const;                  ///< Only valid when fitsInt()
+    bool fitsLongLong() const;          ///< Within +-LLONG_MAX, so negating the result is safe
+    long long toLongLong() const;       ///< Only valid when fitsLongLong()
+    size_t limbs() const { return mag.size(); }
+    std::string toString() const;
+
+    BigInt operator-() const;
+    friend BigInt operator+(const BigInt &, const BigInt &);
+    friend BigInt operator-(const BigInt &, const BigInt &);
+    friend BigInt operator*(const BigInt &, const BigInt &);
+    friend int compare(const BigInt &, const BigInt &); ///< -1, 0 or 1
+
+    /**
+     * @brief Truncating division: a = q * b + r, r has the sign of a
+     *
+     * The divisor must not be zero.
+     */
+    static void divMod(const BigInt &a, const BigInt &b, BigInt &q, BigInt &r);
+    static BigInt gcd(BigInt, BigInt);  ///< Non-negative
+
+private:
+    typedef std::vector<uint32_t> Mag;
+    bool neg;
+    Mag mag;
+
+    BigInt(bool, Mag);
+    static void trim(Mag &);
+    static int compareMag(const Mag &, const Mag &);
+    static Mag addMag(const Mag &, const Mag &);
+    static Mag subMag(const Mag &, const Mag &);   ///< First operand must be the larger
+    static Mag mulMag(const Mag &, const Mag &);
+    static Mag karatsuba(const Mag &, const Mag &);
+    static void divModMag(const Mag &, const Mag &, Mag &, Mag &);
+    static BigInt addSigned(bool, const Mag &, bool, const Mag &);
+};
+
+#endif
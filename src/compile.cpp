@@ -0,0 +1,365 @@
+/**
+ * @file compile.cpp
+ * @brief Compilation of resolved expression trees to bytecode
+ *
+ * Each compile method appends code that leaves exactly one value, the value
+ * of its node, on the operand stack. Calls marked tail by the resolver become
+ * OP_TAIL_CALL, so a lambda body never needs more than its final OP_RETURN.
+ */
+
+#include "vm.hpp"
+#include "RE.hpp"
+
+// ============================================================================
+// Compiler
+// ============================================================================
+
+Chunk::Chunk(int arity) : arity(arity) {}
+
+Compiler::Compiler(Chunk *chunk) : chunk(chunk) {}
+
+void Compiler::emit(int word) {
+    chunk->code.push_back(word);
+}
+
+int Compiler::here() const {
+    return (int)chunk->code.size();
+}
+
+void Compiler::patch(int at, int target) {
+    chunk->code[at] = target;
+}
+
+int Compiler::constant(const Value &v) {
+    chunk->consts.push_back(v);
+    return (int)chunk->consts.size() - 1;
+}
+
+int Compiler::node(ExprBase *e) {
+    chunk->nodes.push_back(e);
+    return (int)chunk->nodes.size() - 1;
+}
+
+// ============================================================================
+// Literals and fallbacks
+// ============================================================================
+
+// Nodes that signal, like (exit), are left to the tree walker
+void ExprBase::compile(Compiler &c) {
+    c.emit(OP_EVAL);
+    c.emit(c.node(this));
+}
+
+void Fixnum::compile(Compiler &c) {
+    c.emit(OP_CONST);
+    c.emit(c.constant(value));
+}
+
+// Literal and quote nodes root their values and outlive every chunk compiled from them
+void Bignum::compile(Compiler &c) {
+    c.emit(OP_CONST);
+    c.emit(c.constant(value.v));
+}
+
+void RationalNum::compile(Compiler &c) {
+    if (value.v.unset()) {
+        ExprBase::compile(c);
+        return;
+    }
+    c.emit(OP_CONST);
+    c.emit(c.constant(value.v));
+}
+
+void StringExpr::compile(Compiler &c) {
+    c.emit(OP_CONST);
+    c.emit(c.constant(value.v));
+}
+
+void True::compile(Compiler &c) {
+    c.emit(OP_CONST);
+    c.emit(c.constant(BooleanV(true)));
+}
+
+void False::compile(Compiler &c) {
+    c.emit(OP_CONST);
+    c.emit(c.constant(BooleanV(false)));
+}
+
+void MakeVoid::compile(Compiler &c) {
+    c.emit(OP_CONST);
+    c.emit(c.constant(VoidV()));
+}
+
+void Quote::compile(Compiler &c) {
+    if (datum.v.unset()) {
+        ExprBase::compile(c);
+        return;
+    }
+    c.emit(OP_CONST);
+    c.emit(c.constant(datum.v));
+}
+
+// ============================================================================
+// Primitives
+// ============================================================================
+
+void Unary::compile(Compiler &c) {
+    rand->compile(c);
+    switch (e_type) {
+        case E_CAR: c.emit(OP_CAR); break;
+        case E_CDR: c.emit(OP_CDR); break;
+        default: c.emit(OP_PRIM1); break;
+    }
+    c.emit(c.node(this));
+}
+
+void Binary::compile(Compiler &c) {
+    rand1->compile(c);
+    rand2->compile(c);
+    switch (e_type) {
+        case E_PLUS: c.emit(OP_ADD); break;
+        case E_MINUS: c.emit(OP_SUB); break;
+        case E_MUL: c.emit(OP_MUL); break;
+        case E_LT: c.emit(OP_LT); break;
+        case E_LE: c.emit(OP_LE); break;
+        case E_EQ: c.emit(OP_NUM_EQ); break;
+        case E_GE: c.emit(OP_GE); break;
+        case E_GT: c.emit(OP_GT); break;
+        case E_CONS: c.emit(OP_CONS); return;
+        default: c.emit(OP_PRIM2); break;
+    }
+    c.emit(c.node(this));
+}
+
+void Variadic::compile(Compiler &c) {
+    for (auto &r : rands) {
+        r->compile(c);
+    }
+    c.emit(OP_PRIMN);
+    c.emit(c.node(this));
+    c.emit((int)rands.size());
+}
+
+// ============================================================================
+// Control flow
+// ============================================================================
+
+void Begin::compile(Compiler &c) {
+    if (es.empty()) {
+        c.emit(OP_CONST);
+        c.emit(c.constant(VoidV()));
+        return;
+    }
+    for (size_t i = 0; i < es.size(); ++i) {
+        if (i > 0) {
+            c.emit(OP_POP);
+        }
+        es[i]->compile(c);
+    }
+}
+
+void If::compile(Compiler &c) {
+    cond->compile(c);
+    c.emit(OP_JUMP_IF_FALSE);
+    int to_alter = c.here();
+    c.emit(0);
+    conseq->compile(c);
+    c.emit(OP_JUMP);
+    int to_end = c.here();
+    c.emit(0);
+    c.patch(to_alter, c.here());
+    alter->compile(c);
+    c.patch(to_end, c.here());
+}
+
+void Cond::compile(Compiler &c) {
+    std::vector<int> to_end;
+    for (auto &clause : clauses) {
+        auto marker = dynamic_cast<Var*>(clause[0].get());
+        if (marker != nullptr && marker->x.str() == "else") {
+            if (clause.size() == 1) {
+                c.emit(OP_CONST);
+                c.emit(c.constant(VoidV()));
+            }
+            for (size_t j = 1; j < clause.size(); ++j) {
+                if (j > 1) {
+                    c.emit(OP_POP);
+                }
+                clause[j]->compile(c);
+            }
+            c.emit(OP_JUMP);
+            to_end.push_back(c.here());
+            c.emit(0);
+            break;
+        }
+        clause[0]->compile(c);
+        if (clause.size() == 1) { // the test's own value is the result
+            c.emit(OP_JUMP_IF_TRUE_KEEP);
+            to_end.push_back(c.here());
+            c.emit(0);
+            continue;
+        }
+        c.emit(OP_JUMP_IF_FALSE);
+        int to_next = c.here();
+        c.emit(0);
+        for (size_t j = 1; j < clause.size(); ++j) {
+            if (j > 1) {
+                c.emit(OP_POP);
+            }
+            clause[j]->compile(c);
+        }
+        c.emit(OP_JUMP);
+        to_end.push_back(c.here());
+        c.emit(0);
+        c.patch(to_next, c.here());
+    }
+    // no clause matched
+    c.emit(OP_CONST);
+    c.emit(c.constant(VoidV()));
+    for (int at : to_end) {
+        c.patch(at, c.here());
+    }
+}
+
+void AndVar::compile(Compiler &c) {
+    if (rands.empty()) {
+        c.emit(OP_CONST);
+        c.emit(c.constant(BooleanV(true)));
+        return;
+    }
+    std::vector<int> to_end;
+    for (size_t i = 0; i + 1 < rands.size(); ++i) {
+        rands[i]->compile(c);
+        c.emit(OP_JUMP_IF_FALSE_KEEP);
+        to_end.push_back(c.here());
+        c.emit(0);
+    }
+    rands.back()->compile(c);
+    for (int at : to_end) {
+        c.patch(at, c.here());
+    }
+}
+
+void OrVar::compile(Compiler &c) {
+    if (rands.empty()) {
+        c.emit(OP_CONST);
+        c.emit(c.constant(BooleanV(false)));
+        return;
+    }
+    std::vector<int> to_end;
+    for (size_t i = 0; i + 1 < rands.size(); ++i) {
+        rands[i]->compile(c);
+        c.emit(OP_JUMP_IF_TRUE_KEEP);
+        to_end.push_back(c.here());
+        c.emit(0);
+    }
+    rands.back()->compile(c);
+    for (int at : to_end) {
+        c.patch(at, c.here());
+    }
+}
+
+// ============================================================================
+// Variables
+// ============================================================================
+
+void Var::compile(Compiler &c) {
+    if (depth >= 0) {
+        c.emit(boxed ? OP_LOCAL_BOXED : OP_LOCAL);
+        c.emit(depth);
+        c.emit(index);
+        return;
+    }
+    c.emit(OP_GLOBAL);
+    c.emit(c.node(this));
+}
+
+void Set::compile(Compiler &c) {
+    e->compile(c);
+    if (depth >= 0) {
+        c.emit(boxed ? OP_STORE_BOXED : OP_STORE_LOCAL);
+        c.emit(depth);
+        c.emit(index);
+    } else {
+        c.emit(OP_SET_GLOBAL);
+        c.emit(c.node(this));
+    }
+    c.emit(OP_CONST);
+    c.emit(c.constant(VoidD()));
+}
+
+void Define::compile(Compiler &c) {
+    e->compile(c);
+    if (depth >= 0) {
+        c.emit(boxed ? OP_STORE_BOXED : OP_STORE_LOCAL);
+        c.emit(depth);
+        c.emit(index);
+    } else {
+        c.emit(OP_DEFINE_GLOBAL);
+        c.emit(c.node(this));
+    }
+    c.emit(OP_CONST);
+    c.emit(c.constant(VoidD()));
+}
+
+// ============================================================================
+// Procedures and binding constructs
+// ============================================================================
+
+// Boxes the slots of a frame just entered that the resolver found captured and assigned
+static void emitBoxes(Compiler &c, const std::vector<bool> &boxed) {
+    for (size_t i = 0; i < boxed.size(); ++i) {
+        if (boxed[i]) {
+            c.emit(OP_MAKE_BOX);
+            c.emit((int)i);
+        }
+    }
+}
+
+void Lambda::compile(Compiler &c) {
+    std::shared_ptr<Chunk> body = std::make_shared<Chunk>((int)x.size());
+    body->captures = captures;
+    Compiler inner(body.get());
+    emitBoxes(inner, boxed);
+    e->compile(inner);
+    inner.emit(OP_RETURN);
+    c.chunk->lambdas.push_back(body);
+    c.emit(OP_CLOSURE);
+    c.emit((int)c.chunk->lambdas.size() - 1);
+}
+
+void Apply::compile(Compiler &c) {
+    rator->compile(c);
+    for (auto &r : rand) {
+        r->compile(c);
+    }
+    c.emit(tail ? OP_TAIL_CALL : OP_CALL);
+    c.emit((int)rand.size());
+}
+
+void Let::compile(Compiler &c) {
+    for (auto &b : bind) {
+        b.second->compile(c);
+    }
+    c.emit(OP_ENTER);
+    c.emit((int)bind.size());
+    emitBoxes(c, boxed);
+    body->compile(c);
+    c.emit(OP_LEAVE);
+}
+
+void Letrec::compile(Compiler &c) {
+    c.emit(OP_ENTER_EMPTY);
+    c.emit((int)bind.size());
+    emitBoxes(c, boxed);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        if (bind[i].second.get() != nullptr) {
+            bind[i].second->compile(c);
+            c.emit(boxed[i] ? OP_STORE_BOXED : OP_STORE_LOCAL);
+            c.emit(0);
+            c.emit((int)i);
+        }
+    }
+    body->compile(c);
+    c.emit(OP_LEAVE);
+}
@@ -11,53 +11,67 @@
 #include "value.hpp"
 #include "expr.hpp" 
 #include "RE.hpp"
+#include "output.hpp"
+#include "profile.hpp"
+#include "stats.hpp"
 #include "syntax.hpp"
 #include <cstring>
 #include <vector>
 #include <map>
 #include <climits>
+#include <unordered_map>
 
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
-Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
-    return IntegerV(n);
+static Value *findPrimitive(Sym);
+
+Value Fixnum::eval(Env &e) { // evaluation of a fixnum
+    return value;
 }
 
-Value RationalNum::eval(Assoc &e) { // evaluation of a rational number
-    return RationalV(numerator, denominator);
+Value Bignum::eval(Env &e) { // evaluation of an integer literal too large for a fixnum
+    return value.v;
 }
 
-Value StringExpr::eval(Assoc &e) { // evaluation of a string
-    return StringV(s);
+Value RationalNum::eval(Env &e) { // evaluation of a rational number
+    if (value.v.unset()) {
+        return RationalV(numerator, denominator);
+    }
+    return value.v;
 }
 
-Value True::eval(Assoc &e) { // evaluation of #t
+Value StringExpr::eval(Env &e) { // evaluation of a string
+    return value.v;
+}
+
+Value True::eval(Env &e) { // evaluation of #t
     return BooleanV(true);
 }
 
-Value False::eval(Assoc &e) { // evaluation of #f
+Value False::eval(Env &e) { // evaluation of #f
     return BooleanV(false);
 }
 
-Value MakeVoid::eval(Assoc &e) { // (void)
+Value MakeVoid::eval(Env &e) { // (void)
     return VoidV();
 }
 
-Value Exit::eval(Assoc &e) { // (exit)
+Value Exit::eval(Env &e) { // (exit)
     return TerminateV();
 }
 
-Value Unary::eval(Assoc &e) { // evaluation of single-operator primitive
+Value Unary::eval(Env &e) { // evaluation of single-operator primitive
     return evalRator(rand->eval(e));
 }
 
-Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
+Value Binary::eval(Env &e) { // evaluation of two-operators primitive
     return evalRator(rand1->eval(e), rand2->eval(e));
 }
 
-Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
+Value Variadic::eval(Env &e) { // evaluation of multi-operator primitive
     std::vector<Value> args;
+    RootedValues rooted(args);
     for (const auto& i : rands) {
         args.emplace_back(i->eval(e));
     }
@@ -66,293 +80,276 @@ Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
     // TODO: TO COMPLETE THE VARIADIC CLASS
 }
 
-Value Var::eval(Assoc &e) { // evaluation of variable
-
-    if (x.empty() || (isdigit(x[0]) || x[0] == '.' || x[0] == '@')) {
-        throw RuntimeError("Invalid variable name: starts with invalid character");
-    }
-
-    const std::string forbidden_chars = "#'\"`";
-    for (char c : x) {
-        if (forbidden_chars.find(c) != std::string::npos) {
-            throw RuntimeError("Invalid variable name: contains forbidden character '" + std::string(1, c) + "'");
+Value Var::eval(Env &e) { // evaluation of variable
+    if (depth >= 0) {
+        Value &slot = locate(depth, index, e);
+        Value &local = boxed ? static_cast<Box*>(slot.get())->v : slot;
+        if (local.unset()) {
+            throw RuntimeError("Variable used before its definition: " + x.str());
         }
+        return local;
     }
 
-    auto isNumeric = [](const std::string &s) -> bool {
-        if (s.empty())
-            return false;
-        size_t i = 0;
-        if (s[i] == '+' || s[i] == '-')
-            i++; // Sign
-        bool has_digit = false;
-        bool has_dot = false;
-        bool has_exponent = false;
-        while (i < s.size()) {
-            if (isdigit(s[i])) {
-                has_digit = true;
-            } else if (s[i] == '.') {
-                if (has_dot || has_exponent)
-                    return false;
-                has_dot = true;
-            } else if (s[i] == 'e' || s[i] == 'E') {
-                if (has_exponent || !has_digit)
-                    return false;
-                has_exponent = true;
-                if (++i >= s.size() || (!isdigit(s[i]) && s[i] != '+' && s[i] != '-')) {
-                    return false;
-                }
-                if (s[i] == '+' || s[i] == '-')
-                    i++;
-                if (i >= s.size() || !isdigit(s[i]))
-                    return false;
-            } else {
-                return false;
-            }
-            i++;
-        }
-        // Must have at least one digit (reject "." or "+.")
-        return has_digit;
-    };
+    // global bindings are never removed, so the cell stays valid once found
+    if (cell == nullptr) {
+        cell = findGlobal(x);
+    }
+    if (cell != nullptr) {
+        return *cell;
+    }
 
-    if (isNumeric(x)) {
-        throw RuntimeError("Invalid variable name: numeric format is prioritized as literal");
+    // a primitive name that is not shadowed evaluates to its built-in procedure
+    if (Value *prim = findPrimitive(x)) {
+        return *prim;
     }
-    // TODO: TO identify the invalid variable
-    // We request all valid variable just need to be a symbol,you should promise:
-    //The first character of a variable name cannot be a digit or any character from the set: {.@}
-    //If a string can be recognized as a number, it will be prioritized as a number. For example: 1, -1, +123, .123, +124., 1e-3
-    //Variable names can overlap with primitives and reserve_words
-    //Variable names can contain any non-whitespace characters except #, ', ", `, but the first character cannot be a digit
-    //When a variable is not defined in the current scope, your interpreter should output RuntimeError
-    
-    Value matched_value = find(x, e);
-    if (matched_value.get() == nullptr) {
-        if (primitives.count(x)) {
-             static std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
-                    {E_VOID,     {new MakeVoid(), {}}},
-                    {E_EXIT,     {new Exit(), {}}},
-                    {E_BOOLQ,    {new IsBoolean(new Var("parm")), {"parm"}}},
-                    {E_INTQ,     {new IsFixnum(new Var("parm")), {"parm"}}},
-                    {E_NULLQ,    {new IsNull(new Var("parm")), {"parm"}}},
-                    {E_PAIRQ,    {new IsPair(new Var("parm")), {"parm"}}},
-                    {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
-                    {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
-                    {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
-                    {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
-                    {E_PLUS,     {new PlusVar({}),  {}}},
-                    {E_MINUS,    {new MinusVar({}), {}}},
-                    {E_MUL,      {new MultVar({}),  {}}},
-                    {E_DIV,      {new DivVar({}),   {}}},
-                    {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-                    {E_EQQ,      {new EqualVar({}), {}}},
-            };
+    throw RuntimeError("Undefined variable: " + x.str());
+}
 
-            auto it = primitive_map.find(primitives[x]);
-            //TODO:to PASS THE parameters correctly;
-            //COMPLETE THE CODE WITH THE HINT IN IF SENTENCE WITH CORRECT RETURN VALUE
-            if (it != primitive_map.end()) {
-                Expr body = it->second.first;
-                std::vector<std::string> parameters = it->second.second;
+// ============================================================================
+// Numeric helpers shared by the binary and variadic arithmetic primitives.
+// An integer mixed with a rational is treated as n/1. Integer results that do
+// not fit a fixnum are promoted to bignums; the overflow check is the only
+// cost on the fixnum path. Rationals with 64-bit parts are combined in 128-bit
+// arithmetic, and only a result that does not fit goes through BigInts.
+// ============================================================================
 
-                return Value(new Procedure(parameters, body, e));
-                //TODO
-            }
-      }
-    }
-    return matched_value;
+static bool isInteger(const Value &v) {
+    return v.type() == V_INT || v.type() == V_BIGINT;
 }
 
-Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
-    if (rand1->v_type == V_VOID) {
-        return IntegerV(0);
-    }
+static bool isNumber(const Value &v) {
+    return isInteger(v) || v.type() == V_RATIONAL || v.type() == V_BIGRATIONAL;
+}
 
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return IntegerV(p1->n + p2->n);
-        }
-    }
+static BigInt bigOf(const Value &v) {
+    return v.type() == V_INT ? BigInt(v.fixnum()) : static_cast<BigNum *>(v.get())->n;
+}
 
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->numerator * p2->denominator + p1->denominator * p2->numerator ,
-                p1->denominator * p2->denominator);
-        }
+// Reads a number as a fraction with 64-bit parts; false if a part is a BigInt
+static bool fraction(const Value &v, long long &num, long long &den) {
+    if (v.type() == V_INT) {
+        num = v.fixnum();
+        den = 1;
+        return true;
     }
-
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->numerator  + p1->denominator * p2->n , p1->denominator );
-        }
+    if (v.type() == V_RATIONAL) {
+        const Rational *r = static_cast<Rational *>(v.get());
+        num = r->numerator;
+        den = r->denominator;
+        return true;
     }
+    return false;
+}
 
-    else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        return Plus::evalRator(rand2, rand1);
+static void bigFraction(const Value &v, BigInt &num, BigInt &den) {
+    if (v.type() == V_BIGRATIONAL) {
+        const BigRational *r = static_cast<BigRational *>(v.get());
+        num = r->numerator;
+        den = r->denominator;
+    } else if (v.type() == V_RATIONAL) {
+        const Rational *r = static_cast<Rational *>(v.get());
+        num = BigInt(r->numerator);
+        den = BigInt(r->denominator);
+    } else {
+        num = bigOf(v);
+        den = BigInt(1);
     }
-
-
-
-    //TODO: To complete the addition logic
-    throw(RuntimeError("Wrong typename"));
 }
 
-Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
-    if (auto it = dynamic_cast<Void*>(rand1.get())) {
-        if (rand2->v_type == V_INT) {
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            return IntegerV(-(p2->n));
-        }else if (rand2->v_type == V_RATIONAL) {
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            return RationalV(-(p2->numerator) , p2->denominator);
-        }
+// A fraction already in lowest terms; unset when a part does not fit 64 bits
+static Value smallFraction(__int128 num, __int128 den) {
+    if (num > LLONG_MAX || num < -LLONG_MAX || den > LLONG_MAX) {
+        return Value(nullptr);
     }
+    return ReducedRationalV((long long)num, (long long)den);
+}
 
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return IntegerV(p1->n - p2->n);
-        }
+// With g = gcd(d1, d2), only a factor of g can be shared by the sum and its
+// denominator (Knuth 4.5.1), so the full gcd of the result is never needed
+static Value addSmall(long long n1, long long d1, long long n2, long long d2) {
+    if (d1 == 1 || d2 == 1) { // an integer plus a fraction is already in lowest terms
+        return smallFraction((__int128)n1 * d2 + (__int128)n2 * d1, (__int128)d1 * d2);
     }
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(
-                p1->numerator * p2->denominator - p1->denominator * p2->numerator,
-                p1->denominator * p2->denominator
-            );
-        }
+    long long g = binaryGcd(d1, d2);
+    __int128 t = (__int128)n1 * (d2 / g) + (__int128)n2 * (d1 / g);
+    if (g == 1) {
+        return smallFraction(t, (__int128)d1 * d2);
     }
+    long long r = (long long)(t % g);
+    long long g2 = binaryGcd(r < 0 ? -r : r, g);
+    return smallFraction(t / g2, (__int128)(d1 / g) * (d2 / g2));
+}
 
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->numerator - p1->denominator * p2->n, p1->denominator);
-        }
+// Cancelling each numerator against the other denominator leaves the product reduced
+static Value mulSmall(long long n1, long long d1, long long n2, long long d2) {
+    if (n1 == 0 || n2 == 0) {
+        return ReducedRationalV(0, 1);
     }
+    long long g1 = binaryGcd(n1 < 0 ? -n1 : n1, d2);
+    long long g2 = binaryGcd(n2 < 0 ? -n2 : n2, d1);
+    return smallFraction((__int128)(n1 / g1) * (n2 / g2), (__int128)(d1 / g2) * (d2 / g1));
+}
 
-    else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-        const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->n * p2->denominator - p2->numerator, p2->denominator);
+static Value addFractions(const Value &rand1, const Value &rand2, bool subtract) {
+    if (!isNumber(rand1) || !isNumber(rand2)) {
+        throw(RuntimeError("Wrong typename"));
+    }
+    long long n1, d1, n2, d2;
+    if (fraction(rand1, n1, d1) && fraction(rand2, n2, d2)) {
+        Value result = addSmall(n1, d1, subtract ? -n2 : n2, d2);
+        if (!result.unset()) {
+            return result;
         }
     }
-
-    //TODO: To complete the substraction logic
-    throw(RuntimeError("Wrong typename"));
+    BigInt bn1, bd1, bn2, bd2;
+    bigFraction(rand1, bn1, bd1);
+    bigFraction(rand2, bn2, bd2);
+    return RationalV(bn1 * bd2 + (subtract ? -bn2 : bn2) * bd1, bd1 * bd2);
 }
 
-Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
-    if (rand1->v_type == V_VOID) {
-        return IntegerV(1);
+static Value mulFractions(const Value &rand1, const Value &rand2, bool divide) {
+    if (!isNumber(rand1) || !isNumber(rand2)) {
+        throw(RuntimeError("Wrong typename"));
     }
-
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return IntegerV(p1->n * p2->n);
+    long long n1, d1, n2, d2;
+    if (fraction(rand1, n1, d1) && fraction(rand2, n2, d2)) {
+        if (divide) {
+            if (n2 == 0) {
+                throw(RuntimeError("Division by zero"));
+            }
+            long long inverted = n2 < 0 ? -d2 : d2;
+            d2 = n2 < 0 ? -n2 : n2;
+            n2 = inverted;
         }
-    }
-
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(
-                p1->numerator * p2->numerator,
-                p1->denominator * p2->denominator
-            );
+        Value result = mulSmall(n1, d1, n2, d2);
+        if (!result.unset()) {
+            return result;
         }
     }
+    BigInt bn1, bd1, bn2, bd2;
+    bigFraction(rand1, bn1, bd1);
+    bigFraction(rand2, bn2, bd2);
+    if (divide) {
+        return RationalV(bn1 * bd2, bd1 * bn2); // RationalV rejects a zero divisor
+    }
+    return RationalV(bn1 * bn2, bd1 * bd2);
+}
 
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->numerator * p2->n, p1->denominator);
+static Value addNumbers(const Value &rand1, const Value &rand2) {
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int n;
+        if (!__builtin_add_overflow(rand1.fixnum(), rand2.fixnum(), &n)) {
+            return IntegerV(n);
         }
+        return IntegerV(BigInt((long long)rand1.fixnum() + rand2.fixnum()));
     }
-
-    else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        return Mult::evalRator(rand2, rand1);
+    if (isInteger(rand1) && isInteger(rand2)) {
+        return IntegerV(bigOf(rand1) + bigOf(rand2));
     }
-    //TODO: To complete the Multiplication logic
-    throw(RuntimeError("Wrong typename"));
+    return addFractions(rand1, rand2, false);
 }
 
-Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
-    if (auto it = dynamic_cast<Void*>(rand1.get())) {
-        if (rand2->v_type == V_INT) {
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            return RationalV(1,p2->n);
-        }else if (rand2->v_type == V_RATIONAL) {
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            return RationalV(p2->denominator , p2->numerator);
+static Value subNumbers(const Value &rand1, const Value &rand2) {
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int n;
+        if (!__builtin_sub_overflow(rand1.fixnum(), rand2.fixnum(), &n)) {
+            return IntegerV(n);
         }
+        return IntegerV(BigInt((long long)rand1.fixnum() - rand2.fixnum()));
+    }
+    if (isInteger(rand1) && isInteger(rand2)) {
+        return IntegerV(bigOf(rand1) - bigOf(rand2));
     }
+    return addFractions(rand1, rand2, true);
+}
 
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            if (p2->n == 0) throw(RuntimeError("Division by zero"));
-            if (p1->n % p2->n == 0)
-                return IntegerV(p1->n / p2->n);
-            else
-                return RationalV(p1->n, p2->n);
+static Value mulNumbers(const Value &rand1, const Value &rand2) {
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int n;
+        if (!__builtin_mul_overflow(rand1.fixnum(), rand2.fixnum(), &n)) {
+            return IntegerV(n);
         }
+        return IntegerV(BigInt((long long)rand1.fixnum() * rand2.fixnum()));
+    }
+    if (isInteger(rand1) && isInteger(rand2)) {
+        return IntegerV(bigOf(rand1) * bigOf(rand2));
     }
+    return mulFractions(rand1, rand2, false);
+}
 
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV( p1->numerator * p2->denominator,
-                p1->denominator * p2->numerator );
-        }
+static Value divNumbers(const Value &rand1, const Value &rand2) {
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int n1 = rand1.fixnum();
+        int n2 = rand2.fixnum();
+        if (n2 == 0) throw(RuntimeError("Division by zero"));
+        if (n2 == -1) return IntegerV(BigInt(-(long long)n1));
+        if (n1 % n2 == 0)
+            return IntegerV(n1 / n2);
+        else
+            return RationalV(n1, n2);
+    }
+    if (isInteger(rand1) && isInteger(rand2)) {
+        BigInt n1 = bigOf(rand1), n2 = bigOf(rand2);
+        if (n2.isZero()) throw(RuntimeError("Division by zero"));
+        BigInt q, r;
+        BigInt::divMod(n1, n2, q, r);
+        if (r.isZero()) {
+            return IntegerV(q);
+        }
+        return RationalV(n1, n2);
+    }
+    return mulFractions(rand1, rand2, true);
+}
+
+Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
+    if (rand1.type() == V_VOID) {
+        return IntegerV(0);
     }
+    return addNumbers(rand1, rand2);
+}
 
-    else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-        const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->numerator, p1->denominator * p2->n);
-        }
+Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
+    if (rand1.type() == V_VOID && isNumber(rand2)) {
+        return subNumbers(IntegerV(0), rand2);
     }
+    return subNumbers(rand1, rand2);
+}
 
-    else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-        const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-        if (p1 && p2) {
-            return RationalV(p1->n * p2->denominator, p2->numerator);
-        }
+Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
+    if (rand1.type() == V_VOID) {
+        return IntegerV(1);
     }
+    return mulNumbers(rand1, rand2);
+}
 
-    //TODO: To complete the dicision logic
-    throw(RuntimeError("Wrong typename"));
+Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
+    if (rand1.type() == V_VOID && isNumber(rand2)) {
+        return divNumbers(IntegerV(1), rand2);
+    }
+    return divNumbers(rand1, rand2);
 }
 
 Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int dividend = dynamic_cast<Integer*>(rand1.get())->n;
-        int divisor = dynamic_cast<Integer*>(rand2.get())->n;
+    if (rand1.type() == V_INT && rand2.type() == V_INT) {
+        int dividend = rand1.fixnum();
+        int divisor = rand2.fixnum();
         if (divisor == 0) {
             throw(RuntimeError("Division by zero"));
         }
+        if (divisor == -1) {
+            return IntegerV(0);
+        }
         return IntegerV(dividend % divisor);
     }
+    if (isInteger(rand1) && isInteger(rand2)) {
+        BigInt divisor = bigOf(rand2);
+        if (divisor.isZero()) {
+            throw(RuntimeError("Division by zero"));
+        }
+        BigInt q, r;
+        BigInt::divMod(bigOf(rand1), divisor, q, r);
+        return IntegerV(r);
+    }
     throw(RuntimeError("modulo is only defined for integers"));
 }
 
@@ -360,268 +357,207 @@ Value PlusVar::evalRator(const std::vector<Value> &args) { // + with multiple ar
     if (args.empty()) throw(RuntimeError("+ requires at least one argument"));
 
     Value result = args[0];
-
-    auto binary_plus = [](const Value& rand1 , const Value& rand2) -> Value {
-        if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2) {
-                return IntegerV(p1->n + p2->n);
-            }
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2) {
-                return RationalV(p1->numerator * p2->denominator + p1->denominator * p2->numerator ,
-                    p1->denominator * p2->denominator);
-            }
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2) {
-                return RationalV(p1->numerator  + p1->denominator * p2->n , p1->denominator );
-            }
-        }
-
-        else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand2.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand1.get());
-            if (p1 && p2) {
-                return RationalV(p1->numerator  + p1->denominator * p2->n , p1->denominator );
-            }
-        }
-
-        //TODO: To complete the addition logic
-        throw(RuntimeError("Wrong typename"));
-    };
-
     for (int i = 1 ; i < args.size() ; ++i) {
-        result = binary_plus(result , args[i]);
+        result = addNumbers(result , args[i]);
     }
-
     return result;
-
-    //TODO: To complete the addition logic
 }
 
 Value MinusVar::evalRator(const std::vector<Value> &args) { // - with multiple args
-
     if (args.empty()) throw(RuntimeError("- requires at least one argument"));
 
     Value result = args[0];
-
-    auto binary_minus = [](const Value &rand1, const Value &rand2) -> Value {
-        if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2) return IntegerV(p1->n - p2->n);
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->numerator * p2->denominator - p1->denominator * p2->numerator,
-                                 p1->denominator * p2->denominator);
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->numerator - p1->denominator * p2->n, p1->denominator);
-        }
-
-        else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->n * p2->denominator - p2->numerator, p2->denominator);
-        }
-
-        throw(RuntimeError("Wrong typename"));
-    };
-
     for (int i = 1; i < args.size(); ++i) {
-        result = binary_minus(result, args[i]);
+        result = subNumbers(result, args[i]);
     }
-
     return result;
-    //TODO: To complete the substraction logic
 }
 
 Value MultVar::evalRator(const std::vector<Value> &args) { // * with multiple args
-
     if (args.empty()) throw(RuntimeError("* requires at least one argument"));
 
     Value result = args[0];
-
-    auto binary_mult = [](const Value &rand1, const Value &rand2) -> Value {
-        if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2) return IntegerV(p1->n * p2->n);
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->numerator * p2->numerator,
-                                 p1->denominator * p2->denominator);
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->numerator * p2->n, p1->denominator);
-        }
-
-        else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->n * p2->numerator, p2->denominator);
-        }
-
-        throw(RuntimeError("Wrong typename"));
-    };
-
     for (int i = 1; i < args.size(); ++i) {
-        result = binary_mult(result, args[i]);
+        result = mulNumbers(result, args[i]);
     }
-
     return result;
-    //TODO: To complete the multiplication logic
 }
 
 Value DivVar::evalRator(const std::vector<Value> &args) { // / with multiple args
-
     if (args.empty()) throw(RuntimeError("/ requires at least one argument"));
 
     Value result = args[0];
-
-    auto binary_div = [](const Value &rand1, const Value &rand2) -> Value {
-        if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2) {
-                if (p2->n == 0) throw(RuntimeError("Division by zero"));
-                if (p1->n % p2->n == 0) return IntegerV(p1->n / p2->n);
-                else return RationalV(p1->n, p2->n);
-            }
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->numerator * p2->denominator,
-                                 p1->denominator * p2->numerator);
-        }
-
-        else if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-            const Rational *p1 = dynamic_cast<Rational *>(rand1.get());
-            const Integer *p2 = dynamic_cast<Integer *>(rand2.get());
-            if (p1 && p2) {
-                if (p2->n == 0) throw(RuntimeError("Division by zero"));
-                return RationalV(p1->numerator, p1->denominator * p2->n);
-            }
-        }
-
-        else if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-            const Integer *p1 = dynamic_cast<Integer *>(rand1.get());
-            const Rational *p2 = dynamic_cast<Rational *>(rand2.get());
-            if (p1 && p2)
-                return RationalV(p1->n * p2->denominator, p2->numerator);
-        }
-
-        throw(RuntimeError("Wrong typename"));
-    };
-
     for (int i = 1; i < args.size(); ++i) {
-        result = binary_div(result, args[i]);
+        result = divNumbers(result, args[i]);
     }
-
     return result;
-    //TODO: To complete the divisor logic
 }
 
 Value Expt::evalRator(const Value &rand1, const Value &rand2) { // expt
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int base = dynamic_cast<Integer*>(rand1.get())->n;
-        int exponent = dynamic_cast<Integer*>(rand2.get())->n;
+    if (isInteger(rand1) && rand2.type() == V_INT) {
+        int exponent = rand2.fixnum();
         
         if (exponent < 0) {
             throw(RuntimeError("Negative exponent not supported for integers"));
         }
-        if (base == 0 && exponent == 0) {
+        if (rand1.type() == V_INT && rand1.fixnum() == 0 && exponent == 0) {
             throw(RuntimeError("0^0 is undefined"));
         }
         
-        long long result = 1;
-        long long b = base;
-        int exp = exponent;
-        
-        while (exp > 0) {
-            if (exp % 2 == 1) {
-                result *= b;
-                if (result > INT_MAX || result < INT_MIN) {
-                    throw(RuntimeError("Integer overflow in expt"));
+        // square and multiply in long long while every step stays a fixnum
+        if (rand1.type() == V_INT) {
+            long long result = 1;
+            long long b = rand1.fixnum();
+            int exp = exponent;
+            while (exp > 0) {
+                if (exp % 2 == 1) {
+                    result *= b;
+                    if (result > INT_MAX || result < INT_MIN) {
+                        break;
+                    }
                 }
-            }
-            b *= b;
-            if (b > INT_MAX || b < INT_MIN) {
-                if (exp > 1) {
-                    throw(RuntimeError("Integer overflow in expt"));
+                exp /= 2;
+                if (exp > 0) {
+                    b *= b;
+                    if (b > INT_MAX || b < INT_MIN) {
+                        break;
+                    }
                 }
             }
-            exp /= 2;
+            if (exp == 0) {
+                return IntegerV((int)result);
+            }
         }
         
-        return IntegerV((int)result);
+        BigInt result(1);
+        BigInt b = bigOf(rand1);
+        for (int exp = exponent; exp > 0; exp /= 2) {
+            if (exp % 2 == 1) {
+                result = result * b;
+            }
+            if (exp > 1) {
+                b = b * b;
+            }
+        }
+        return IntegerV(result);
+    }
+    if (isInteger(rand1) && rand2.type() == V_BIGINT) {
+        throw(RuntimeError("Exponent too large"));
     }
     throw(RuntimeError("Wrong typename"));
 }
 
+// Signs, then integer parts, settle most comparisons; only the fractional
+// parts of numbers that agree on both are cross-multiplied
+static int compareFractions(long long n1, long long d1, long long n2, long long d2) {
+    if ((n1 < 0) != (n2 < 0)) {
+        return n1 < 0 ? -1 : 1;
+    }
+    long long q1 = n1 / d1, r1 = n1 % d1;
+    long long q2 = n2 / d2, r2 = n2 % d2;
+    if (r1 < 0) { --q1; r1 += d1; }
+    if (r2 < 0) { --q2; r2 += d2; }
+    if (q1 != q2) {
+        return q1 < q2 ? -1 : 1;
+    }
+    __int128 left = (__int128)r1 * d2;
+    __int128 right = (__int128)r2 * d1;
+    return (left < right) ? -1 : (left > right) ? 1 : 0;
+}
+
 //A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
 int compareNumericValues(const Value &v1, const Value &v2) {
-    if (v1->v_type == V_INT && v2->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(v1.get())->n;
-        int n2 = dynamic_cast<Integer*>(v2.get())->n;
+    if (v1.type() == V_INT && v2.type() == V_INT) {
+        int n1 = v1.fixnum();
+        int n2 = v2.fixnum();
         return (n1 < n2) ? -1 : (n1 > n2) ? 1 : 0;
     }
-    else if (v1->v_type == V_RATIONAL && v2->v_type == V_INT) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        int n2 = dynamic_cast<Integer*>(v2.get())->n;
-        int left = r1->numerator;
-        int right = n2 * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
+    if (isInteger(v1) && isInteger(v2)) {
+        return compare(bigOf(v1), bigOf(v2));
+    }
+    if (!isNumber(v1) || !isNumber(v2)) {
+        throw RuntimeError("Wrong typename in numeric comparison");
     }
-    else if (v1->v_type == V_INT && v2->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(v1.get())->n;
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        int left = n1 * r2->denominator;
-        int right = r2->numerator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
+    long long n1, d1, n2, d2;
+    if (fraction(v1, n1, d1) && fraction(v2, n2, d2)) {
+        return compareFractions(n1, d1, n2, d2);
     }
-    else if (v1->v_type == V_RATIONAL && v2->v_type == V_RATIONAL) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        int left = r1->numerator * r2->denominator;
-        int right = r2->numerator * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
+    BigInt bn1, bd1, bn2, bd2;
+    bigFraction(v1, bn1, bd1);
+    bigFraction(v2, bn2, bd2);
+    if (bn1.negative() != bn2.negative()) {
+        return bn1.negative() ? -1 : 1;
     }
-    throw RuntimeError("Wrong typename in numeric comparison");
+    return compare(bn1 * bd2, bn2 * bd1);
+}
+
+Value NumericBinary::eval(Env &e) { // arithmetic or comparison on its observed operand types
+    Value rand1_val = rand1->eval(e);
+    Value rand2_val = rand2->eval(e);
+    if (shape == UNSEEN) {
+        if (rand1_val.type() == V_INT && rand2_val.type() == V_INT) {
+            shape = FIXNUMS;
+        } else if (rand1_val.type() == V_RATIONAL && rand2_val.type() == V_RATIONAL) {
+            shape = RATIONALS;
+        } else {
+            shape = GENERIC;
+        }
+    }
+
+    if (shape == FIXNUMS) {
+        if (rand1_val.type() == V_INT && rand2_val.type() == V_INT) {
+            int x = rand1_val.fixnum();
+            int y = rand2_val.fixnum();
+            int n;
+            switch (e_type) {
+                case E_PLUS: if (!__builtin_add_overflow(x, y, &n)) return IntegerV(n); break;
+                case E_MINUS: if (!__builtin_sub_overflow(x, y, &n)) return IntegerV(n); break;
+                case E_MUL: if (!__builtin_mul_overflow(x, y, &n)) return IntegerV(n); break;
+                case E_DIV: if (y != 0 && y != -1 && x % y == 0) return IntegerV(x / y); break;
+                case E_LT: return BooleanV(x < y);
+                case E_LE: return BooleanV(x <= y);
+                case E_EQ: return BooleanV(x == y);
+                case E_GE: return BooleanV(x >= y);
+                case E_GT: return BooleanV(x > y);
+                default: break;
+            }
+        } else {
+            shape = GENERIC;
+        }
+    } else if (shape == RATIONALS) {
+        if (rand1_val.type() == V_RATIONAL && rand2_val.type() == V_RATIONAL) {
+            const Rational *p = static_cast<Rational *>(rand1_val.get());
+            const Rational *q = static_cast<Rational *>(rand2_val.get());
+            Value result(nullptr);
+            switch (e_type) {
+                case E_PLUS: result = addSmall(p->numerator, p->denominator, q->numerator, q->denominator); break;
+                case E_MINUS: result = addSmall(p->numerator, p->denominator, -q->numerator, q->denominator); break;
+                case E_MUL: result = mulSmall(p->numerator, p->denominator, q->numerator, q->denominator); break;
+                case E_DIV:
+                    if (q->numerator != 0) {
+                        long long sign = q->numerator < 0 ? -1 : 1;
+                        result = mulSmall(p->numerator, p->denominator, sign * q->denominator, sign * q->numerator);
+                    }
+                    break;
+                case E_LT: return BooleanV(compareFractions(p->numerator, p->denominator, q->numerator, q->denominator) < 0);
+                case E_LE: return BooleanV(compareFractions(p->numerator, p->denominator, q->numerator, q->denominator) <= 0);
+                case E_EQ: return BooleanV(compareFractions(p->numerator, p->denominator, q->numerator, q->denominator) == 0);
+                case E_GE: return BooleanV(compareFractions(p->numerator, p->denominator, q->numerator, q->denominator) >= 0);
+                case E_GT: return BooleanV(compareFractions(p->numerator, p->denominator, q->numerator, q->denominator) > 0);
+                default: break;
+            }
+            if (!result.unset()) {
+                return result;
+            }
+        } else {
+            shape = GENERIC;
+        }
+    }
+    return evalRator(rand1_val, rand2_val);
 }
 
 Value Less::evalRator(const Value &rand1, const Value &rand2) { // <
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+    if (isNumber(rand1) && isNumber(rand2))
     {
         bool ans = (compareNumericValues(rand1 , rand2) == -1);
         return BooleanV(ans);
@@ -631,7 +567,7 @@ Value Less::evalRator(const Value &rand1, const Value &rand2) { // <
 }
 
 Value LessEq::evalRator(const Value &rand1, const Value &rand2) { // <=
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+    if (isNumber(rand1) && isNumber(rand2))
     {
         bool ans = (compareNumericValues(rand1 , rand2) != 1);
         return BooleanV(ans);
@@ -641,7 +577,7 @@ Value LessEq::evalRator(const Value &rand1, const Value &rand2) { // <=
 }
 
 Value Equal::evalRator(const Value &rand1, const Value &rand2) { // =
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+    if (isNumber(rand1) && isNumber(rand2))
     {
         bool ans = (compareNumericValues(rand1 , rand2) == 0);
         return BooleanV(ans);
@@ -651,7 +587,7 @@ Value Equal::evalRator(const Value &rand1, const Value &rand2) { // =
 }
 
 Value GreaterEq::evalRator(const Value &rand1, const Value &rand2) { // >=
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+    if (isNumber(rand1) && isNumber(rand2))
     {
         bool ans = (compareNumericValues(rand1 , rand2) != -1);
         return BooleanV(ans);
@@ -661,7 +597,7 @@ Value GreaterEq::evalRator(const Value &rand1, const Value &rand2) { // >=
 }
 
 Value Greater::evalRator(const Value &rand1, const Value &rand2) { // >
-    if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+    if (isNumber(rand1) && isNumber(rand2))
     {
         bool ans = (compareNumericValues(rand1 , rand2) == 1);
         return BooleanV(ans);
@@ -672,7 +608,7 @@ Value Greater::evalRator(const Value &rand1, const Value &rand2) { // >
 
 Value LessVar::evalRator(const std::vector<Value> &args) { // < with multiple args
     auto cmp = [](const Value &rand1, const Value &rand2)->bool {
-        if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) && (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+        if (isNumber(rand1) && isNumber(rand2))
         {
             bool ans = (compareNumericValues(rand1 , rand2) == -1);
             return ans;
@@ -690,8 +626,7 @@ Value LessVar::evalRator(const std::vector<Value> &args) { // < with multiple ar
 
 Value LessEqVar::evalRator(const std::vector<Value> &args) { // <= with multiple args
     auto cmp = [](const Value &rand1, const Value &rand2)->bool {
-        if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) &&
-            (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+        if (isNumber(rand1) && isNumber(rand2))
         {
             bool ans = (compareNumericValues(rand1, rand2) != 1);
             return ans;
@@ -709,8 +644,7 @@ Value LessEqVar::evalRator(const std::vector<Value> &args) { // <= with multiple
 
 Value EqualVar::evalRator(const std::vector<Value> &args) { // = with multiple args
     auto cmp = [](const Value &rand1, const Value &rand2)->bool {
-        if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) &&
-            (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+        if (isNumber(rand1) && isNumber(rand2))
         {
             bool ans = (compareNumericValues(rand1, rand2) == 0);
             return ans;
@@ -728,8 +662,7 @@ Value EqualVar::evalRator(const std::vector<Value> &args) { // = with multiple a
 
 Value GreaterEqVar::evalRator(const std::vector<Value> &args) { // >= with multiple args
     auto cmp = [](const Value &rand1, const Value &rand2)->bool {
-        if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) &&
-            (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+        if (isNumber(rand1) && isNumber(rand2))
         {
             bool ans = (compareNumericValues(rand1, rand2) != -1);
             return ans;
@@ -747,8 +680,7 @@ Value GreaterEqVar::evalRator(const std::vector<Value> &args) { // >= with multi
 
 Value GreaterVar::evalRator(const std::vector<Value> &args) { // > with multiple args
     auto cmp = [](const Value &rand1, const Value &rand2)->bool {
-        if ((rand1->v_type == V_INT || rand1->v_type == V_RATIONAL) &&
-            (rand2->v_type == V_INT || rand2->v_type == V_RATIONAL))
+        if (isNumber(rand1) && isNumber(rand2))
         {
             bool ans = (compareNumericValues(rand1, rand2) == 1);
             return ans;
@@ -782,14 +714,14 @@ Value ListFunc::evalRator(const std::vector<Value> &args) { // list function
 
 Value IsList::evalRator(const Value &rand) { // list?
 
-    if (rand->v_type == V_PAIR) {
+    if (rand.type() == V_PAIR) {
 
         auto check = dynamic_cast<Pair*>(rand.get());
 
-        if (check->cdr->v_type == V_PAIR) {
+        if (check->cdr.type() == V_PAIR) {
             return IsList::evalRator(check->cdr);
 
-        }else if (check->cdr->v_type == V_NULL) {
+        }else if (check->cdr.type() == V_NULL) {
             return BooleanV(true);
 
         }else {
@@ -813,11 +745,11 @@ Value Car::evalRator(const Value &rand) {
 
 Value Cdr::evalRator(const Value &rand) { // cdr
 
-    if (rand->v_type == V_NULL) {
+    if (rand.type() == V_NULL) {
         return NullV();
     }
 
-    if (rand->v_type != V_PAIR) {
+    if (rand.type() != V_PAIR) {
         throw RuntimeError("cdr expects a pair");
     }
 
@@ -827,77 +759,77 @@ Value Cdr::evalRator(const Value &rand) { // cdr
 }
 
 Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
-    //TODO: To complete the set-car! logic
+    auto p = dynamic_cast<Pair*>(rand1.get());
+    if (!p) {
+        throw RuntimeError("set-car! expects a pair");
+    }
+    p->car = rand2;
+    return VoidD();
 }
 
 Value SetCdr::evalRator(const Value &rand1, const Value &rand2) { // set-cdr!
-   //TODO: To complete the set-cdr! logic
+    auto p = dynamic_cast<Pair*>(rand1.get());
+    if (!p) {
+        throw RuntimeError("set-cdr! expects a pair");
+    }
+    p->cdr = rand2;
+    return VoidD();
 }
 
 Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
-    // 检查类型是否为 Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return BooleanV((dynamic_cast<Integer*>(rand1.get())->n) == (dynamic_cast<Integer*>(rand2.get())->n));
-    }
-    // 检查类型是否为 Boolean
-    else if (rand1->v_type == V_BOOL && rand2->v_type == V_BOOL) {
-        return BooleanV((dynamic_cast<Boolean*>(rand1.get())->b) == (dynamic_cast<Boolean*>(rand2.get())->b));
-    }
     // 检查类型是否为 Symbol
-    else if (rand1->v_type == V_SYM && rand2->v_type == V_SYM) {
+    if (rand1.type() == V_SYM && rand2.type() == V_SYM) {
         return BooleanV((dynamic_cast<Symbol*>(rand1.get())->s) == (dynamic_cast<Symbol*>(rand2.get())->s));
     }
-    // 检查类型是否为 Null 或 Void
-    else if ((rand1->v_type == V_NULL && rand2->v_type == V_NULL) ||
-             (rand1->v_type == V_VOID && rand2->v_type == V_VOID)) {
-        return BooleanV(true);
-    } else {
-        return BooleanV(rand1.get() == rand2.get());
-    }
+    // 整数、布尔、空表与 void 都是立即数，同值即同一个字
+    return BooleanV(rand1.identical(rand2));
 }
 
 Value IsBoolean::evalRator(const Value &rand) { // boolean?
-    return BooleanV(rand->v_type == V_BOOL);
+    return BooleanV(rand.type() == V_BOOL);
 }
 
 Value IsFixnum::evalRator(const Value &rand) { // number?
-    return BooleanV(rand->v_type == V_INT);
+    return BooleanV(isInteger(rand));
 }
 
 Value IsNull::evalRator(const Value &rand) { // null?
-    return BooleanV(rand->v_type == V_NULL);
+    return BooleanV(rand.type() == V_NULL);
 }
 
 Value IsPair::evalRator(const Value &rand) { // pair?
-    return BooleanV(rand->v_type == V_PAIR);
+    return BooleanV(rand.type() == V_PAIR);
 }
 
 Value IsProcedure::evalRator(const Value &rand) { // procedure?
-    return BooleanV(rand->v_type == V_PROC);
+    return BooleanV(rand.type() == V_PROC || rand.type() == V_PRIMITIVE);
 }
 
 Value IsSymbol::evalRator(const Value &rand) { // symbol?
-    return BooleanV(rand->v_type == V_SYM);
+    return BooleanV(rand.type() == V_SYM);
 }
 
 Value IsString::evalRator(const Value &rand) { // string?
-    return BooleanV(rand->v_type == V_STRING);
+    return BooleanV(rand.type() == V_STRING);
 }
 
-Value Begin::eval(Assoc &e) {
+Value Begin::eval(Env &e) {
     for (auto it = es.begin() ; it != es.end() ; ++it) {
         if (it == es.end()-1) {
             return (*it) -> eval(e);
         }
         (*it)->eval(e);
     }
-    //TODO: To complete the begin logic
+    return VoidV(); // an empty begin, as Begin::compile treats it
 }
 
 Value convert(const Syntax& s) {
     if (auto Num = dynamic_cast<Number*>(s.get())) {
         return IntegerV(Num->n);
     }
+    if (auto Big = dynamic_cast<BigNumber*>(s.get())) {
+        return IntegerV(Big->n);
+    }
     if (auto Rat = dynamic_cast<RationalSyntax*>(s.get())) {
         return RationalV(Rat->numerator , Rat->denominator);
     }
@@ -922,7 +854,7 @@ Value convert(const Syntax& s) {
         auto stxs = Lst->stxs;
         for (size_t i = 0; i < stxs.size(); ++i) {
             if (auto sym = dynamic_cast<SymbolSyntax *>(stxs[i].get())) {
-                if (sym->s == ".") {
+                if (sym->s.str() == ".") {
                     ++dot_count;
                     if (dot_pos < 0) dot_pos = i;
                 }
@@ -934,6 +866,7 @@ Value convert(const Syntax& s) {
         }
         if (dot_count == 0) {
             std::vector<Value> result;
+            RootedValues rooted(result);
             for (const auto& i : Lst->stxs) {
                 result.emplace_back(convert(i));
             }
@@ -955,6 +888,7 @@ Value convert(const Syntax& s) {
         }
         else {
             std::vector<Value> result;
+            RootedValues rooted(result);
             for (const auto& i : Lst->stxs) {
                 result.emplace_back(convert(i));
             }
@@ -975,86 +909,60 @@ Value convert(const Syntax& s) {
     throw RuntimeError("Wrong Type");
 }
 
-Value Quote::eval(Assoc& e) {
-    return convert(s);
-    //TODO: To complete the quote logic
+Value Quote::eval(Env &e) {
+    if (datum.v.unset()) {
+        return convert(s);
+    }
+    return datum.v;
 }
 
-Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
+Value AndVar::eval(Env &e) { // and with short-circuit evaluation
     if (rands.empty()) {
         return BooleanV(true) ;
     }
 
-    Value result = VoidV();
-
-    for (auto &expr : rands) {
-        result = expr->eval(e);
-
-        if (auto b = dynamic_cast<Boolean*>(result.get())) {
-            if (!b->b) return BooleanV(false); // short circuit
-        }
+    for (size_t i = 0; i + 1 < rands.size(); ++i) {
+        if (rands[i]->eval(e).isFalse()) return BooleanV(false); // short circuit
     }
 
-    return result;
+    return rands.back()->eval(e); // tail position
 
     //TODO: To complete the and logic
 }
 
-Value OrVar::eval(Assoc &e) { // or with short-circuit evaluation
+Value OrVar::eval(Env &e) { // or with short-circuit evaluation
     if (rands.empty()) {
         return BooleanV(false);
     }
-    Value result = VoidV();
-    for (const auto& i : rands) {
-        result = i->eval(e);
-        if (result->v_type != V_BOOL) {
+    for (size_t i = 0; i + 1 < rands.size(); ++i) {
+        Value result = rands[i]->eval(e);
+        if (!result.isFalse()) {
             return result;
-        }else {
-            if (dynamic_cast<Boolean*>(result.get())->b == true) {
-                return BooleanV(true);
-            }
         }
-
     }
-    return BooleanV(false);
+    return rands.back()->eval(e); // tail position
     //TODO: To complete the or logic
 }
 
 Value Not::evalRator(const Value &rand) { // not
-    if (rand->v_type == V_BOOL) {
-        auto pt = dynamic_cast<Boolean*>(rand.get());
-        if (pt->b == false) {
-            return BooleanV(true);
-        }
-    }
-    return BooleanV(false);
+    return BooleanV(rand.isFalse());
     //TODO: To complete the not logic
 }
 
-Value If::eval(Assoc &e) {
+Value If::eval(Env &e) {
     auto condition = cond->eval(e);
-    if (condition->v_type == V_BOOL) {
-        auto i = dynamic_cast<Boolean*>(condition.get());
-        if (i->b == false) {
-            return alter->eval(e);
-        }
+    if (condition.isFalse()) {
+        return alter->eval(e);
     }
     return conseq->eval(e);
     //TODO: To complete the if logic
 }
 
-bool test_conditional(const Expr& cond , Assoc &e) {
-    auto condition = cond->eval(e);
-    if (condition->v_type == V_BOOL) {
-        auto i = dynamic_cast<Boolean*>(condition.get());
-        if (i->b == false) {
-            return false;
-        }
-    }
-    return true;
+bool test_conditional(const Expr& cond , Env &e) {
+    return !cond->eval(e).isFalse();
 }
 
-Value Cond::eval(Assoc &env) {
+Value Cond::eval(Env &env) {
     // clauses: vector<vector<Expr>>
     // 每个 clause 至少应当有一个元素 (predicate 或 'else')
     for (size_t i = 0; i < clauses.size(); ++i) {
@@ -1065,7 +973,7 @@ Value Cond::eval(Assoc &env) {
 
         bool is_else = false;
         if (auto varPtr = dynamic_cast<Var*>(clause[0].get())) {
-            if (varPtr->x == "else") is_else = true;
+            if (varPtr->x.str() == "else") is_else = true;
         }
 
         if (is_else) {
@@ -1077,18 +985,16 @@ Value Cond::eval(Assoc &env) {
             if (clause.size() == 1) return VoidV();
 
             // 顺序执行 consequents，返回最后一个的值
-            Value result = VoidV();
-            for (size_t j = 1; j < clause.size(); ++j) {
-                result = clause[j]->eval(env);
+            for (size_t j = 1; j + 1 < clause.size(); ++j) {
+                clause[j]->eval(env);
             }
-            return result;
+            return clause.back()->eval(env);
         } else {
             // 普通子句：先计算 predicate（且只计算一次）
             Value test_val = clause[0]->eval(env);
 
             // 判定 truthiness：只有 #f （V_BOOL 且 false）为假，其它都为真
-            bool is_false = (test_val->v_type == V_BOOL) &&
-                            (dynamic_cast<Boolean*>(test_val.get())->b == false);
+            bool is_false = test_val.isFalse();
 
             if (!is_false) {
                 // predicate 为真：如果没有后续表达式则返回 predicate 的值
@@ -1096,11 +1002,10 @@ Value Cond::eval(Assoc &env) {
                     return test_val;
                 }
                 // 否则顺序执行 consequents，返回最后一个的值
-                Value result = VoidV();
-                for (size_t j = 1; j < clause.size(); ++j) {
-                    result = clause[j]->eval(env);
+                for (size_t j = 1; j + 1 < clause.size(); ++j) {
+                    clause[j]->eval(env);
                 }
-                return result;
+                return clause.back()->eval(env);
             }
             // predicate 为假：继续检查下一个 clause
         }
@@ -1110,15 +1015,29 @@ Value Cond::eval(Assoc &env) {
     return VoidV();
 }
 
-Value Lambda::eval(Assoc &env) {
-    return ProcedureV(x,e,env);
-    //TODO: To complete the lambda logic
+// Builds a flat closure holding only the free variables the body uses
+Value Lambda::eval(Env &env) {
+    Env closure;
+    if (!captures.empty()) {
+        closure = makeFrame(captures.size(), Env());
+        for (size_t i = 0; i < captures.size(); ++i) {
+            closure->slots()[i] = locate(captures[i].first, captures[i].second, env);
+        }
+    }
+    Value proc = ProcedureV(x, e, closure);
+    for (bool b : boxed) {
+        if (b) {
+            static_cast<Procedure*>(proc.get())->boxed = boxed;
+            break;
+        }
+    }
+    return proc;
 }
 
-// Value Apply::eval(Assoc &e) {
+// Value Apply::eval(Env &e) {
 //     Value rator_val = rator->eval(e);
 //
-//     if (rator_val.get() == nullptr || rator_val->v_type != V_PROC) {
+//     if (rator_val.get() == nullptr || rator_val.type() != V_PROC) {
 //         throw RuntimeError("Attempt to apply a non-procedure");
 //     }
 //     //TODO: TO COMPLETE THE CLOSURE LOGIC
@@ -1146,156 +1065,324 @@ Value Lambda::eval(Assoc &env) {
 // }
 
 
-Value Apply::eval(Assoc &e) {
-	Value proc_val = rator->eval(e);
-    if (proc_val->v_type != V_PROC) {throw RuntimeError("Attempt to apply a non-procedure");}
-    //TODO: TO COMPLETE THE CLOSURE LOGIC
-    Procedure* clos_ptr = dynamic_cast<Procedure*>(proc_val.get());
-	 if (!clos_ptr) {
+// ============================================================================
+// Built-in procedures as values. Each primitive name gets one Primitive whose
+// fn calls the same evalRator that the parser's dedicated node uses.
+// evalRator never reads the node's operands, so one shared instance per node
+// type serves every call.
+// ============================================================================
+
+template <typename Node>
+static Value unaryPrim(const Value *args, int argc) {
+    static Node node{Expr(nullptr)};
+    return node.Node::evalRator(args[0]);
+}
+
+template <typename Node>
+static Value binaryPrim(const Value *args, int argc) {
+    static Node node{Expr(nullptr), Expr(nullptr)};
+    return node.Node::evalRator(args[0], args[1]);
+}
+
+template <typename Node>
+static Value variadicPrim(const Value *args, int argc) {
+    static Node node{std::vector<Expr>()};
+    std::vector<Value> copy(args, args + argc);
+    RootedValues rooted(copy);
+    return node.Node::evalRator(copy);
+}
+
+// Arithmetic and comparison take the binary node's path for two operands
+template <typename BinaryNode, typename VariadicNode>
+static Value chainPrim(const Value *args, int argc) {
+    if (argc == 2) {
+        return binaryPrim<BinaryNode>(args, argc);
+    }
+    return variadicPrim<VariadicNode>(args, argc);
+}
+
+static Value plusPrim(const Value *args, int argc) { // (+) is 0
+    return argc == 0 ? IntegerV(0) : chainPrim<Plus, PlusVar>(args, argc);
+}
+
+static Value multPrim(const Value *args, int argc) { // (*) is 1
+    return argc == 0 ? IntegerV(1) : chainPrim<Mult, MultVar>(args, argc);
+}
+
+static Value minusPrim(const Value *args, int argc) { // (- x) negates
+    if (argc == 1) {
+        Value operands[2] = {IntegerV(0), args[0]};
+        return binaryPrim<Minus>(operands, 2);
+    }
+    return chainPrim<Minus, MinusVar>(args, argc);
+}
+
+static Value divPrim(const Value *args, int argc) { // (/ x) is the reciprocal
+    if (argc == 1) {
+        Value operands[2] = {IntegerV(1), args[0]};
+        return binaryPrim<Div>(operands, 2);
+    }
+    return chainPrim<Div, DivVar>(args, argc);
+}
+
+static Value voidPrim(const Value *args, int argc) {
+    return VoidV();
+}
+
+static Value exitPrim(const Value *args, int argc) {
+    return TerminateV();
+}
+
+static Value flushPrim(const Value *args, int argc) {
+    flushOutput();
+    return VoidD();
+}
+
+static Value runtimeStatsPrim(const Value *args, int argc) {
+    return runtimeStatsList();
+}
+
+static std::unordered_map<Sym, Value> &primitiveTable() {
+    static std::unordered_map<Sym, Value> table;
+    return table;
+}
+
+static struct PrimitivesRoot : GcRoot {
+    virtual void trace() override {
+        for (auto &p : primitiveTable()) {
+            gcMark(p.second);
+        }
+    }
+} primitives_root;
+
+static Value *findPrimitive(Sym name) {
+    struct Entry { ExprType type; PrimitiveFn fn; int min_args; int max_args; };
+    static const Entry entries[] = {
+        {E_VOID,     voidPrim,                       0, 0},
+        {E_EXIT,     exitPrim,                       0, 0},
+        {E_BOOLQ,    unaryPrim<IsBoolean>,           1, 1},
+        {E_INTQ,     unaryPrim<IsFixnum>,            1, 1},
+        {E_NULLQ,    unaryPrim<IsNull>,              1, 1},
+        {E_PAIRQ,    unaryPrim<IsPair>,              1, 1},
+        {E_PROCQ,    unaryPrim<IsProcedure>,         1, 1},
+        {E_SYMBOLQ,  unaryPrim<IsSymbol>,            1, 1},
+        {E_STRINGQ,  unaryPrim<IsString>,            1, 1},
+        {E_LISTQ,    unaryPrim<IsList>,              1, 1},
+        {E_DISPLAY,  unaryPrim<Display>,             1, 1},
+        {E_FLUSH,    flushPrim,                      0, 0},
+        {E_RUNTIME_STATS, runtimeStatsPrim,          0, 0},
+        {E_NOT,      unaryPrim<Not>,                 1, 1},
+        {E_CAR,      unaryPrim<Car>,                 1, 1},
+        {E_CDR,      unaryPrim<Cdr>,                 1, 1},
+        {E_CONS,     binaryPrim<Cons>,               2, 2},
+        {E_SETCAR,   binaryPrim<SetCar>,             2, 2},
+        {E_SETCDR,   binaryPrim<SetCdr>,             2, 2},
+        {E_EQQ,      binaryPrim<IsEq>,               2, 2},
+        {E_MODULO,   binaryPrim<Modulo>,             2, 2},
+        {E_EXPT,     binaryPrim<Expt>,               2, 2},
+        {E_LIST,     variadicPrim<ListFunc>,         0, -1},
+        {E_PLUS,     plusPrim,                       0, -1},
+        {E_MUL,      multPrim,                       0, -1},
+        {E_MINUS,    minusPrim,                      1, -1},
+        {E_DIV,      divPrim,                        1, -1},
+        {E_LT,       chainPrim<Less, LessVar>,       2, -1},
+        {E_LE,       chainPrim<LessEq, LessEqVar>,   2, -1},
+        {E_EQ,       chainPrim<Equal, EqualVar>,     2, -1},
+        {E_GE,       chainPrim<GreaterEq, GreaterEqVar>, 2, -1},
+        {E_GT,       chainPrim<Greater, GreaterVar>, 2, -1},
+    };
+    std::unordered_map<Sym, Value> &table = primitiveTable();
+    if (table.empty()) {
+        for (auto &p : primitives) {
+            for (auto &entry : entries) {
+                if (entry.type == p.second) {
+                    Sym sym = intern(p.first);
+                    table.insert(std::make_pair(sym, Value(new Primitive(sym, entry.fn, entry.min_args, entry.max_args))));
+                }
+            }
+        }
+    }
+    auto it = table.find(name);
+    return it == table.end() ? nullptr : &it->second;
+}
+
+/**
+ * @brief The call most recently deferred by a tail Apply
+ *
+ * Written immediately before TailCallV() is returned and read by the
+ * trampoline it returns to; nothing is evaluated in between.
+ */
+static struct PendingCall : GcRoot {
+    Value proc;
+    Env frame;
+    PendingCall() : proc(nullptr) {}
+    virtual void trace() override {
+        gcMark(proc);
+        gcMark(frame.get());
+    }
+} pending_call;
+
+// Runs a procedure body, timed as one activation when TIMED
+template <bool TIMED>
+static Value runBody(Procedure *proc, Env &frame) {
+    if (TIMED) {
+        ProfileScope scope(proc->e.get());
+        return proc->e->eval(frame);
+    }
+    return proc->e->eval(frame);
+}
+
+template <bool TIMED>
+static Value apply(Apply &call, Env &e) {
+    const Expr &rator = call.rator;
+    const std::vector<Expr> &rand = call.rand;
+    Value proc_val = rator->eval(e);
+    int argc = rand.size();
+
+    if (proc_val.type() == V_PRIMITIVE) {
+        ++runtime_stats.first_class_primitive_calls;
+        Primitive *prim = static_cast<Primitive*>(proc_val.get());
+        // a few arguments fit on the stack, so calling a primitive allocates nothing
+        Value small[4] = {nullptr, nullptr, nullptr, nullptr};
+        std::vector<Value> large;
+        RootedValues rooted(large);
+        Value *args = small;
+        if (argc > 4) {
+            large.assign(argc, Value(nullptr));
+            args = large.data();
+        }
+        for (int i = 0; i < argc; ++i) {
+            args[i] = rand[i]->eval(e);
+        }
+        if (argc < prim->min_args || (prim->max_args >= 0 && argc > prim->max_args)) {
+            throw RuntimeError("Wrong number of arguments");
+        }
+        return prim->fn(args, argc);
+    }
+
+    if (proc_val.type() != V_PROC) {
         throw RuntimeError("Attempt to apply a non-procedure");
     }
-    //TODO: TO COMPLETE THE ARGUMENT PARSER LOGIC
-    std::vector<Value> args;
-	for (const auto& arg_expr : rand) {
-    	args.push_back(arg_expr->eval(e));
-	}
-   bool is_variadic = false;
-	// 判断是否为可变参数函数
-	if (auto varNode = dynamic_cast<Variadic*>(clos_ptr->e.get())) {
-    	is_variadic = true;  // 标记为可变参数，后续跳过严格的数量检查
-	}
-    if (!is_variadic&&args.size() != clos_ptr->parameters.size()) throw RuntimeError("Wrong number of arguments");
-
-    //TODO: TO COMPLETE THE PARAMETERS' ENVIRONMENT LOGIC
-    Assoc param_env = clos_ptr->env;
-	for (size_t i = 0; i < clos_ptr->parameters.size(); ++i) {
-        param_env = extend (clos_ptr->parameters[i], args[i] , param_env);  //w 绑定形参和实参
-    }
-	if (auto* makeVoid = dynamic_cast<MakeVoid*>(clos_ptr->e.get())) {
-        return makeVoid->eval(e);  // MakeVoid无参数，直接调用eval
-    } else if (auto* exitFunc = dynamic_cast<Exit*>(clos_ptr->e.get())) {
-        return exitFunc->eval(e);  // Exit无参数，直接调用eval
-    }
-    // 2. 单参数内置函数（isboolean、isfixnum、null?、pair?、procedure?、symbol?、string?、display、not、null?、pair?、islist、car、cdr）
-    else if (auto* isBoolean = dynamic_cast<IsBoolean*>(clos_ptr->e.get())) {
-        return isBoolean->evalRator(args[0]);  // boolean? 接收1个参数
-    } else if (auto* isFixnum = dynamic_cast<IsFixnum*>(clos_ptr->e.get())) {
-        return isFixnum->evalRator(args[0]);  // isfixnum 接收1个参数
-    } else if (auto* isNull = dynamic_cast<IsNull*>(clos_ptr->e.get())) {
-        return isNull->evalRator(args[0]);  // null? 接收1个参数
-    } else if (auto* isPair = dynamic_cast<IsPair*>(clos_ptr->e.get())) {
-        return isPair->evalRator(args[0]);  // pair? 接收1个参数
-    } else if (auto* isProcedure = dynamic_cast<IsProcedure*>(clos_ptr->e.get())) {
-        return isProcedure->evalRator(args[0]);  // procedure? 接收1个参数
-    } else if (auto* isSymbol = dynamic_cast<IsSymbol*>(clos_ptr->e.get())) {
-        return isSymbol->evalRator(args[0]);  // symbol? 接收1个参数
-    } else if (auto* isString = dynamic_cast<IsString*>(clos_ptr->e.get())) {
-        return isString->evalRator(args[0]);  // string? 接收1个参数
-    } else if (auto* displayFunc = dynamic_cast<Display*>(clos_ptr->e.get())) {
-        return displayFunc->evalRator(args[0]);  // display 接收1个参数
-    } else if (auto* notFunc = dynamic_cast<Not*>(clos_ptr->e.get())) {
-        return notFunc->evalRator(args[0]);  // not 接收1个参数
-    } else if (auto* isList = dynamic_cast<IsList*>(clos_ptr->e.get())) {
-        return isList->evalRator(args[0]);  // list? 接收1个参数
-    } else if (auto* carFunc = dynamic_cast<Car*>(clos_ptr->e.get())) {
-        return carFunc->evalRator(args[0]);  // car 接收1个参数
-    } else if (auto* cdrFunc = dynamic_cast<Cdr*>(clos_ptr->e.get())) {
-        return cdrFunc->evalRator(args[0]);  // cdr 接收1个参数
-    }
-    // 3. 双参数内置函数（modulo、expt、eq?、cons、set-car!、set-cdr!）
-    else if (auto* moduloFunc = dynamic_cast<Modulo*>(clos_ptr->e.get())) {
-        return moduloFunc->evalRator(args[0], args[1]);  // modulo 接收2个参数
-    } else if (auto* exptFunc = dynamic_cast<Expt*>(clos_ptr->e.get())) {
-        return exptFunc->evalRator(args[0], args[1]);  // expt 接收2个参数
-    } else if (auto* isEq = dynamic_cast<IsEq*>(clos_ptr->e.get())) {
-        return isEq->evalRator(args[0], args[1]);  // eq? 接收2个参数
-    } else if (auto* consFunc = dynamic_cast<Cons*>(clos_ptr->e.get())) {
-        return consFunc->evalRator(args[0], args[1]);  // cons 接收2个参数
-    } else if (auto* setCar = dynamic_cast<SetCar*>(clos_ptr->e.get())) {
-        return setCar->evalRator(args[0], args[1]);  // set-car! 接收2个参数
-    } else if (auto* setCdr = dynamic_cast<SetCdr*>(clos_ptr->e.get())) {
-        return setCdr->evalRator(args[0], args[1]);  // set-cdr! 接收2个参数
-    }
-    // 4. 可变参数内置函数（+、-、*、/、=、<、<=、>、>=、list）
-    else if (auto* plusVar = dynamic_cast<PlusVar*>(clos_ptr->e.get())) {
-        return plusVar->evalRator(args);  // + 接收可变参数（vector<Value>）
-    } else if (auto* minusVar = dynamic_cast<MinusVar*>(clos_ptr->e.get())) {
-        return minusVar->evalRator(args);  // - 接收可变参数
-    } else if (auto* multVar = dynamic_cast<MultVar*>(clos_ptr->e.get())) {
-        return multVar->evalRator(args);  // * 接收可变参数
-    } else if (auto* divVar = dynamic_cast<DivVar*>(clos_ptr->e.get())) {
-        return divVar->evalRator(args);  // / 接收可变参数（注意：你原代码中DivVar::evalRator调用了Dis，需改为Div）
-    } else if (auto* equalVar = dynamic_cast<EqualVar*>(clos_ptr->e.get())) {
-        return equalVar->evalRator(args);  // = 接收可变参数
-    } else if (auto* lessVar = dynamic_cast<LessVar*>(clos_ptr->e.get())) {
-        return lessVar->evalRator(args);  // < 接收可变参数
-    } else if (auto* lessEqVar = dynamic_cast<LessEqVar*>(clos_ptr->e.get())) {
-        return lessEqVar->evalRator(args);  // <= 接收可变参数
-    } else if (auto* greaterVar = dynamic_cast<GreaterVar*>(clos_ptr->e.get())) {
-        return greaterVar->evalRator(args);  // > 接收可变参数
-    } else if (auto* greaterEqVar = dynamic_cast<GreaterEqVar*>(clos_ptr->e.get())) {
-        return greaterEqVar->evalRator(args);  // >= 接收可变参数
-    } else if (auto* listFunc = dynamic_cast<ListFunc*>(clos_ptr->e.get())) {
-        return listFunc->evalRator(args);  // list 接收可变参数
-    }
-    // -------------------------- 非内置函数：执行用户lambda函数 --------------------------
-    else {
-        return clos_ptr->e->eval(param_env);
-    }
-}
-
-
-
-Value Define::eval(Assoc &env) {
-
-
-    if (e.get()->e_type == E_LAMBDA) {
-        // 当 parser 已经将 (define (f x y) body) 翻译为
-        // Define("f", Lambda({x,y}, body))
-        Value val = e->eval(env);
-
-        Value existing = find(var, env);
-        if (existing.get() != nullptr) {
-            modify(var, val, env);
-        } else {
-            env = extend(var, val, env);
+    Procedure* clos_ptr = static_cast<Procedure*>(proc_val.get());
+    ++runtime_stats.procedure_calls;
+
+    // arguments are evaluated straight into the callee's frame, its only allocation
+    Env param_env = makeFrame(argc, clos_ptr->env);
+    Value *args = param_env->slots();
+    for (int i = 0; i < argc; ++i) {
+        args[i] = rand[i]->eval(e);
+    }
+    if (argc != (int)clos_ptr->parameters.size()) {
+        throw RuntimeError("Wrong number of arguments");
+    }
+    for (size_t i = 0; i < clos_ptr->boxed.size(); ++i) {
+        if (clos_ptr->boxed[i]) {
+            args[i] = BoxV(args[i]);
         }
+    }
+    if (call.tail) {
+        ++runtime_stats.tail_calls;
+        pending_call.proc = proc_val;
+        pending_call.frame = param_env;
+        return TailCallV();
+    }
 
-        return VoidD();
+    // trampoline: calls made in tail position by this body run here, one after another
+    Value result = runBody<TIMED>(clos_ptr, param_env);
+    while (result.isTailCall()) {
+        Value proc = pending_call.proc;
+        Env frame = pending_call.frame;
+        pending_call.frame = Env();
+        result = runBody<TIMED>(static_cast<Procedure*>(proc.get()), frame);
     }
+    return result;
+}
+
+Value Apply::eval(Env &e) {
+    return apply<false>(*this, e);
+}
+
+Value ProfiledApply::eval(Env &e) {
+    return apply<true>(*this, e);
+}
 
+Value Define::eval(Env &env) {
     Value val = e->eval(env);
 
-    Value existing = find(var, env);
-    if (existing.get() != nullptr) {
-        modify(var, val, env);
-    } else {
-        env = extend(var, val, env);
+    if (depth >= 0) { // internal define: the slot was reserved when the body was entered
+        Value &slot = locate(depth, index, env);
+        (boxed ? static_cast<Box*>(slot.get())->v : slot) = val;
+        return VoidD();
     }
 
+    defineGlobal(var, val);
     return VoidD();
 }
 
-
-Value Let::eval(Assoc &env) {
-    //TODO: To complete the let logic
+Value Let::eval(Env &env) {
+    // the inits see the outer environment only, so they fill the new frame directly
+    Env let_env = makeFrame(bind.size(), env);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        Value val = bind[i].second->eval(env);
+        let_env->slots()[i] = boxed[i] ? BoxV(val) : val;
+    }
+    return body->eval(let_env);
 }
 
-Value Letrec::eval(Assoc &env) {
-    //TODO: To complete the letrec logic
+Value Letrec::eval(Env &env) {
+    Env rec_env = makeFrame(bind.size(), env);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        if (boxed[i]) {
+            rec_env->slots()[i] = BoxV(Value(nullptr));
+        }
+    }
+
+    // a binding without an initializer is the slot of an internal define
+    for (size_t i = 0; i < bind.size(); ++i) {
+        if (bind[i].second.get() != nullptr) {
+            Value val = bind[i].second->eval(rec_env);
+            Value &slot = rec_env->slots()[i];
+            (boxed[i] ? static_cast<Box*>(slot.get())->v : slot) = val;
+        }
+    }
+    return body->eval(rec_env);
 }
 
-Value Set::eval(Assoc &env) {
-    //TODO: To complete the set logic
+Value Set::eval(Env &env) {
+    Value val = e->eval(env);
+
+    if (depth >= 0) {
+        Value &slot = locate(depth, index, env);
+        (boxed ? static_cast<Box*>(slot.get())->v : slot) = val;
+        return VoidD();
+    }
+
+    if (cell == nullptr) {
+        cell = findGlobal(var);
+    }
+    if (cell == nullptr) {
+        throw RuntimeError("set! on an undefined variable: " + var.str());
+    }
+    *cell = val;
+    return VoidD();
 }
 
 Value Display::evalRator(const Value &rand) { // display function
-    if (rand->v_type == V_STRING) {
+    if (rand.type() == V_STRING) {
         String* str_ptr = dynamic_cast<String*>(rand.get());
-        std::cout << str_ptr->s;
+        out() << str_ptr->s;
     } else {
-        rand->show(std::cout);
+        rand.show(out());
     }
     
     return VoidD();
 }
+
+Value FlushOutput::eval(Env &e) { // (flush-output)
+    flushOutput();
+    return VoidD();
+}
+
+Value RuntimeStatistics::eval(Env &e) { // (runtime-stats)
+    return runtimeStatsList();
+}
@@ -1,5 +1,7 @@
 #include "Def.hpp"
 #include "expr.hpp"
+#include "arena.hpp"
+#include "RE.hpp"
 #include <cstring>
 #include <cstdlib>
 #include <vector>
@@ -19,16 +21,25 @@ int gcd(int a, int b) {
 
 ExprBase::ExprBase(ExprType et) : e_type(et) {}
 
+static void destroyExpr(void *p) {
+    static_cast<ExprBase *>(p)->~ExprBase();
+}
+
+void *ExprBase::operator new(size_t size) { return currentArena().allocate(size, destroyExpr); }
+void ExprBase::operator delete(void *p) { currentArena().forget(p); }
+
 Expr::Expr(ExprBase * eb) : ptr(eb) {}
-ExprBase* Expr::operator->() const { return ptr.get(); }
+ExprBase* Expr::operator->() const { return ptr; }
 ExprBase& Expr::operator*() { return *ptr; }
-ExprBase* Expr::get() const { return ptr.get(); }
+ExprBase* Expr::get() const { return ptr; }
 
 //BASIC TYPES AND LITERALS
 
-Fixnum::Fixnum(int x) : ExprBase(E_FIXNUM), n(x) {}
+Fixnum::Fixnum(int x) : ExprBase(E_FIXNUM), n(x), value(IntegerV(x)) {}
 
-RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num), denominator(den) {
+Bignum::Bignum(const BigInt &x) : ExprBase(E_BIGNUM), n(x), value(IntegerV(x)) {}
+
+RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num), denominator(den), value(Value(nullptr)) {
     // 简化分数
     int g = gcd(abs(numerator), abs(denominator));
     numerator /= g;
@@ -39,9 +50,12 @@ RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num
         numerator = -numerator;
         denominator = -denominator;
     }
+    if (denominator != 0) { // otherwise eval raises the division by zero
+        value.v = ReducedRationalV(numerator, denominator);
+    }
 }
 
-StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str) {}
+StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str), value(StringV(str)) {}
 
 True::True() : ExprBase(E_TRUE) {}
 
@@ -57,17 +71,20 @@ Unary::Unary(ExprType et, const Expr &expr) : ExprBase(et), rand(expr) {}
 
 Binary::Binary(ExprType et, const Expr &r1, const Expr &r2) : ExprBase(et), rand1(r1), rand2(r2) {}
 
+NumericBinary::NumericBinary(ExprType et, const Expr &r1, const Expr &r2)
+    : Binary(et, r1, r2), shape(UNSEEN) {}
+
 Variadic::Variadic(ExprType et, const std::vector<Expr> &rands) : ExprBase(et), rands(rands) {}
 
 //ARITHMETIC OPERATIONS
 
-Plus::Plus(const Expr &r1, const Expr &r2) : Binary(E_PLUS, r1, r2) {}
+Plus::Plus(const Expr &r1, const Expr &r2) : NumericBinary(E_PLUS, r1, r2) {}
 
-Minus::Minus(const Expr &r1, const Expr &r2) : Binary(E_MINUS, r1, r2) {}
+Minus::Minus(const Expr &r1, const Expr &r2) : NumericBinary(E_MINUS, r1, r2) {}
 
-Mult::Mult(const Expr &r1, const Expr &r2) : Binary(E_MUL, r1, r2) {}
+Mult::Mult(const Expr &r1, const Expr &r2) : NumericBinary(E_MUL, r1, r2) {}
 
-Div::Div(const Expr &r1, const Expr &r2) : Binary(E_DIV, r1, r2) {}
+Div::Div(const Expr &r1, const Expr &r2) : NumericBinary(E_DIV, r1, r2) {}
 
 Modulo::Modulo(const Expr &r1, const Expr &r2) : Binary(E_MODULO, r1, r2) {}
 
@@ -83,15 +100,15 @@ DivVar::DivVar(const std::vector<Expr> &rands) : Variadic(E_DIV, rands) {}
 
 //COMPARISON OPERATIONS
 
-Less::Less(const Expr &r1, const Expr &r2) : Binary(E_LT, r1, r2) {}
+Less::Less(const Expr &r1, const Expr &r2) : NumericBinary(E_LT, r1, r2) {}
 
-LessEq::LessEq(const Expr &r1, const Expr &r2) : Binary(E_LE, r1, r2) {}
+LessEq::LessEq(const Expr &r1, const Expr &r2) : NumericBinary(E_LE, r1, r2) {}
 
-Equal::Equal(const Expr &r1, const Expr &r2) : Binary(E_EQ, r1, r2) {}
+Equal::Equal(const Expr &r1, const Expr &r2) : NumericBinary(E_EQ, r1, r2) {}
 
-GreaterEq::GreaterEq(const Expr &r1, const Expr &r2) : Binary(E_GE, r1, r2) {}
+GreaterEq::GreaterEq(const Expr &r1, const Expr &r2) : NumericBinary(E_GE, r1, r2) {}
 
-Greater::Greater(const Expr &r1, const Expr &r2) : Binary(E_GT, r1, r2) {}
+Greater::Greater(const Expr &r1, const Expr &r2) : NumericBinary(E_GT, r1, r2) {}
 
 LessVar::LessVar(const std::vector<Expr> &rands) : Variadic(E_LT, rands) {}
 
@@ -149,7 +166,13 @@ IsString::IsString(const Expr &r1) : Unary(E_STRINGQ, r1) {}
 
 Begin::Begin(const vector<Expr> &vec) : ExprBase(E_BEGIN), es(vec) {}
 
-Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t) {}
+Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t), datum(Value(nullptr)) {
+    try {
+        datum.v = convert(s);
+    } catch (const RuntimeError &) {
+        // a malformed dotted list fails when the quote is evaluated, as before
+    }
+}
 
 //CONDITIONAL
 
@@ -159,24 +182,33 @@ Cond::Cond(const std::vector<std::vector<Expr>> &cls) : ExprBase(E_COND), clause
 
 //VARIABLE AND FUNCITON DEFINITION
 
-Var::Var(const string &s) : ExprBase(E_VAR), x(s) {}
+Var::Var(Sym s) : ExprBase(E_VAR), x(s), depth(-1), index(0), cell(nullptr), boxed(false) {}
+
+Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec), tail(false) {}
 
-Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec) {}
+ProfiledApply::ProfiledApply(const Expr &expr, const vector<Expr> &vec) : Apply(expr, vec) {}
 
-Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
+// procedures made from the body can outlive the form, so the form's nodes must stay
+Lambda::Lambda(const vector<Sym> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr), line(0) {
+    currentArena().retain();
+}
 
-Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
+Define::Define(Sym variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr), depth(-1), index(0), boxed(false) {}
 
 //BINDING CONSTRUCTS
 
-Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
+Let::Let(const vector<pair<Sym, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
 
-Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
+Letrec::Letrec(const vector<pair<Sym, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
 
 //ASSIGNMENT
 
-Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e) {}
+Set::Set(Sym var, const Expr &e) : ExprBase(E_SET), var(var), e(e), depth(-1), index(0), cell(nullptr), boxed(false) {}
 
 //I/O OPERATIONS
 
-Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
\ No newline at end of file
+Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
+
+FlushOutput::FlushOutput() : ExprBase(E_FLUSH) {}
+
+RuntimeStatistics::RuntimeStatistics() : ExprBase(E_RUNTIME_STATS) {}
\ No newline at end of file
@@ -7,7 +7,7 @@ public:
     int numerator;
     int denominator;
     RationalNum(int num, int den);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };p
  * @brief Expression structures for the Scheme interpreter
  * @author luke36
@@ -19,24 +19,23 @@ public:
 
 #include "Def.hpp"
 #include "syntax.hpp"
+#include "value.hpp"
 #include <memory>
 #include <cstring>
 #include <vector>
 
+// Allocated in the current arena (arena.hpp) and freed with it
 struct ExprBase{
     ExprType e_type;
     ExprBase(ExprType);
-    virtual Value eval(Assoc &) = 0;
+    virtual Value eval(Env &) = 0;
+    virtual void resolve(Scope &);
+    virtual void markTail();
+    virtual void compile(Compiler &);
+    virtual Expr fold();
     virtual ~ExprBase() = default;
-};
-
-class Expr {
-    std::shared_ptr<ExprBase> ptr;
-public:
-    Expr(ExprBase *);
-    ExprBase* operator->() const;
-    ExprBase& operator*();
-    ExprBase* get() const;
+    static void *operator new(size_t);
+    static void operator delete(void *);
 };
 
 // ================================================================================
@@ -49,8 +48,21 @@ public:
  */
 struct Fixnum : ExprBase {
   int n;
+  Value value;          ///< IntegerV(n), an immediate
   Fixnum(int);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
+};
+
+/**
+ * @brief Integer literal too large for a fixnum
+ */
+struct Bignum : ExprBase {
+  BigInt n;
+  RootedValue value;    ///< Built once with the node
+  Bignum(const BigInt &);
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
 };
 
 /**
@@ -60,8 +72,10 @@ struct Fixnum : ExprBase {
 struct RationalNum : ExprBase {
   int numerator;
   int denominator;
+  RootedValue value;    ///< Built once with the node; unset for a zero denominator
   RationalNum(int num, int den);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
 };
 
 /**
@@ -70,8 +84,10 @@ struct RationalNum : ExprBase {
  */
 struct StringExpr : ExprBase {
   std::string s;
+  RootedValue value;    ///< Shared by every evaluation; strings are never mutated
   StringExpr(const std::string &);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
 };
 
 /**
@@ -79,7 +95,8 @@ struct StringExpr : ExprBase {
  */
 struct True : ExprBase {
   True();
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
 };
 
 /**
@@ -87,17 +104,19 @@ struct True : ExprBase {
  */
 struct False : ExprBase {
   False();
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
 };
 
 struct MakeVoid : ExprBase {
     MakeVoid();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
 };
 
 struct Exit : ExprBase {
     Exit();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -108,7 +127,10 @@ struct Unary : ExprBase {
     Expr rand;
     Unary(ExprType, const Expr &);
     virtual Value evalRator(const Value &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
 };
 
 struct Binary : ExprBase {
@@ -116,36 +138,57 @@ struct Binary : ExprBase {
     Expr rand2;
     Binary(ExprType, const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+};
+
+/**
+ * @brief Binary arithmetic or comparison that specializes on its operand types
+ *
+ * The first evaluation records whether both operands were fixnums or both
+ * rationals with 64-bit parts. From then on the node computes that case
+ * inline behind a check of the two tags, and calls evalRator only for
+ * anything else. Once the check fails the node stays on the generic path.
+ */
+struct NumericBinary : Binary {
+    enum Shape : unsigned char { UNSEEN, FIXNUMS, RATIONALS, GENERIC };
+    Shape shape;
+    NumericBinary(ExprType, const Expr &, const Expr &);
+    virtual Value eval(Env &) override;
 };
 
 struct Variadic : ExprBase {
     std::vector<Expr> rands;
     Variadic(ExprType, const std::vector<Expr> &);
     virtual Value evalRator(const std::vector<Value> &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
 };
 
 // ================================================================================
 //                             ARITHMETIC OPERATIONS
 // ================================================================================
 
-struct Plus : Binary {
+struct Plus : NumericBinary {
     Plus(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Minus : Binary {
+struct Minus : NumericBinary {
     Minus(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Mult : Binary {
+struct Mult : NumericBinary {
     Mult(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Div : Binary {
+struct Div : NumericBinary {
     Div(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
@@ -184,27 +227,27 @@ struct DivVar : Variadic {
 //                             COMPARISON OPERATIONS
 // ================================================================================
 
-struct Less : Binary {
+struct Less : NumericBinary {
     Less(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct LessEq : Binary {
+struct LessEq : NumericBinary {
     LessEq(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Equal : Binary {
+struct Equal : NumericBinary {
     Equal(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct GreaterEq : Binary {
+struct GreaterEq : NumericBinary {
     GreaterEq(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
-struct Greater : Binary {
+struct Greater : NumericBinary {
     Greater(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
 };
@@ -280,13 +323,21 @@ struct Not : Unary {
 struct AndVar : ExprBase {
     std::vector<Expr> rands;
     AndVar(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;  
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
 };
 
 struct OrVar : ExprBase {
     std::vector<Expr> rands;
     OrVar(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
 };
 
 // ================================================================================
@@ -345,15 +396,32 @@ struct IsString : Unary {
 struct Begin : ExprBase {
     std::vector<Expr> es;
     Begin(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
 };
 
+/**
+ * @brief Quoted datum, converted once when the node is built
+ *
+ * Every evaluation returns the same datum, so mutating a quoted list is
+ * visible the next time the quote is evaluated, as with any literal constant.
+ */
 struct Quote : ExprBase {
   Syntax s;
+  RootedValue datum;    ///< Unset if converting s throws; eval then reports the error
   Quote(const Syntax &);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
 };
 
+/**
+ * @brief Builds the value a quoted syntax tree denotes
+ */
+Value convert(const Syntax &);
+
 // ================================================================================
 //                             CONDITIONALS
 // ================================================================================
@@ -363,13 +431,21 @@ struct If : ExprBase {
   Expr conseq;
   Expr alter;
   If(const Expr &, const Expr &, const Expr &);
-  virtual Value eval(Assoc &) override;
+  virtual Value eval(Env &) override;
+  virtual void compile(Compiler &) override;
+  virtual Expr fold() override;
+  virtual void resolve(Scope &) override;
+  virtual void markTail() override;
 };
 
 struct Cond : ExprBase {
     std::vector<std::vector<Expr>> clauses;
     Cond(const std::vector<std::vector<Expr>> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
 };
 
 // ================================================================================
@@ -377,30 +453,62 @@ struct Cond : ExprBase {
 // ================================================================================
 
 struct Var : ExprBase {
-    std::string x;
-    Var(const std::string &);
-    virtual Value eval(Assoc &) override;
+    Sym x;
+    int depth;          ///< Frames to skip in the local environment, -1 for a global
+    int index;          ///< Slot within that frame
+    Value *cell;        ///< Global binding, cached on first successful lookup
+    bool boxed;         ///< The local slot holds a Box around the value
+    Var(Sym);
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual void resolve(Scope &) override;
 };
 
 struct Apply : ExprBase {
     Expr rator;
     std::vector<Expr> rand;
+    bool tail;          ///< Last action of a procedure body; hands the call back as TailCallV()
     Apply(const Expr &, const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
+};
+
+/**
+ * @brief An Apply that times the procedure bodies it runs, built under --profile
+ */
+struct ProfiledApply : Apply {
+    ProfiledApply(const Expr &, const std::vector<Expr> &);
+    virtual Value eval(Env &) override;
 };
 
 struct Lambda : ExprBase {
-    std::vector<std::string> x;
+    std::vector<Sym> x;
     Expr e;
-    Lambda(const std::vector<std::string> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    Sym name;           ///< Set when the lambda is the value of a define; empty otherwise
+    int line;           ///< Where the lambda starts; 0 when the input does not count lines
+    std::vector<std::pair<int, int>> captures; ///< Address of each free variable where the lambda is evaluated
+    std::vector<bool> boxed;                   ///< Parameters that must be boxed on entry
+    Lambda(const std::vector<Sym> &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
 };
 
 struct Define : ExprBase {
-    std::string var;
+    Sym var;
     Expr e;
-    Define(const std::string &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int depth;          ///< Frame of an internal define, -1 for a top-level one
+    int index;          ///< Slot reserved for it in that frame
+    bool boxed;
+    Define(Sym, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
 };
 
 // ================================================================================
@@ -408,17 +516,27 @@ struct Define : ExprBase {
 // ================================================================================
 
 struct Let : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    std::vector<std::pair<Sym, Expr>> bind;
     Expr body;
-    Let(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    std::vector<bool> boxed;                   ///< Bindings that live in a Box
+    Let(const std::vector<std::pair<Sym, Expr>> &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
 };
 
 struct Letrec : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    std::vector<std::pair<Sym, Expr>> bind;
     Expr body;
-    Letrec(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    std::vector<bool> boxed;
+    Letrec(const std::vector<std::pair<Sym, Expr>> &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
+    virtual void markTail() override;
 };
 
 // ================================================================================
@@ -426,10 +544,17 @@ struct Letrec : ExprBase {
 // ================================================================================
 
 struct Set : ExprBase {
-    std::string var;
+    Sym var;
     Expr e;
-    Set(const std::string &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int depth;          ///< Same addressing as Var::depth
+    int index;
+    Value *cell;
+    bool boxed;
+    Set(Sym, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void compile(Compiler &) override;
+    virtual Expr fold() override;
+    virtual void resolve(Scope &) override;
 };
 
 // ================================================================================
@@ -441,4 +566,14 @@ struct Display : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+struct FlushOutput : ExprBase {
+    FlushOutput();
+    virtual Value eval(Env &) override;
+};
+
+struct RuntimeStatistics : ExprBase {
+    RuntimeStatistics();
+    virtual Value eval(Env &) override;
+};
+
 #endif
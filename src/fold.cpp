@@ -0,0 +1,231 @@
+/**
+ * @file fold.cpp
+ * @brief Implementation of constant folding
+ *
+ * Each fold method folds the node's children in place and returns the
+ * expression that should stand where the node was, which is the node itself
+ * unless it could be simplified. New nodes go to the current arena, like the
+ * ones the parser made.
+ */
+
+#include "fold.hpp"
+#include "value.hpp"
+#include "RE.hpp"
+#include <climits>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static bool isLiteral(const Expr &e) {
+    switch (e->e_type) {
+        case E_FIXNUM:
+        case E_BIGNUM:
+        case E_RATIONAL:
+        case E_TRUE:
+        case E_FALSE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Evaluating it can neither fail nor change anything, so an unused value can be dropped
+static bool isEffectFree(const Expr &e) {
+    return isLiteral(e) || e->e_type == E_STRING || e->e_type == E_VOID ||
+           e->e_type == E_QUOTE || e->e_type == E_LAMBDA;
+}
+
+// Primitives whose value depends only on their operands
+static bool isPure(ExprType t) {
+    switch (t) {
+        case E_PLUS: case E_MINUS: case E_MUL: case E_DIV: case E_MODULO: case E_EXPT:
+        case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT:
+        case E_NOT: case E_EQQ:
+        case E_BOOLQ: case E_INTQ: case E_NULLQ: case E_PAIRQ: case E_PROCQ:
+        case E_SYMBOLQ: case E_LISTQ: case E_STRINGQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The literal node that evaluates to v, or a null Expr if there is none
+static Expr literal(const Value &v) {
+    switch (v.type()) {
+        case V_INT:
+            return Expr(new Fixnum(v.fixnum()));
+        case V_BIGINT:
+            return Expr(new Bignum(static_cast<BigNum *>(v.get())->n));
+        case V_RATIONAL: {
+            const Rational *r = static_cast<Rational *>(v.get());
+            if (r->numerator >= INT_MIN && r->numerator <= INT_MAX && r->denominator <= INT_MAX) {
+                return Expr(new RationalNum((int)r->numerator, (int)r->denominator));
+            }
+            return Expr(nullptr);
+        }
+        case V_BOOL:
+            return v.isFalse() ? Expr(new False()) : Expr(new True());
+        default:
+            return Expr(nullptr);
+    }
+}
+
+// Evaluates a pure primitive whose operands are literals, or keeps it if that fails
+static Expr evaluateConstant(ExprBase *node) {
+    try {
+        Env none;
+        Expr lit = literal(node->eval(none));
+        if (lit.get() != nullptr) {
+            return lit;
+        }
+    } catch (const RuntimeError &) {
+        // left to raise the error at run time
+    }
+    return Expr(node);
+}
+
+static void foldAll(std::vector<Expr> &es) {
+    for (auto &e : es) {
+        e = e->fold();
+    }
+}
+
+static bool allLiteral(const std::vector<Expr> &es) {
+    for (const auto &e : es) {
+        if (!isLiteral(e)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void fold(Expr &expr) {
+    expr = expr->fold();
+}
+
+// ============================================================================
+// Primitives
+// ============================================================================
+
+Expr ExprBase::fold() { // literals, variables, quote, void, exit
+    return Expr(this);
+}
+
+Expr Unary::fold() {
+    rand = rand->fold();
+    if (isPure(e_type) && isLiteral(rand)) {
+        return evaluateConstant(this);
+    }
+    return Expr(this);
+}
+
+Expr Binary::fold() {
+    rand1 = rand1->fold();
+    rand2 = rand2->fold();
+    if (isPure(e_type) && isLiteral(rand1) && isLiteral(rand2)) {
+        return evaluateConstant(this);
+    }
+    return Expr(this);
+}
+
+Expr Variadic::fold() {
+    foldAll(rands);
+    if (isPure(e_type) && allLiteral(rands)) {
+        return evaluateConstant(this);
+    }
+    return Expr(this);
+}
+
+// ============================================================================
+// Control flow
+// ============================================================================
+
+Expr AndVar::fold() {
+    foldAll(rands);
+    return Expr(this);
+}
+
+Expr OrVar::fold() {
+    foldAll(rands);
+    return Expr(this);
+}
+
+Expr Begin::fold() {
+    if (es.empty()) {
+        return Expr(this);
+    }
+    foldAll(es);
+    std::vector<Expr> kept;
+    for (size_t i = 0; i + 1 < es.size(); ++i) {
+        if (!isEffectFree(es[i])) {
+            kept.push_back(es[i]);
+        }
+    }
+    if (kept.empty()) {
+        return es.back();
+    }
+    kept.push_back(es.back());
+    es = kept;
+    return Expr(this);
+}
+
+Expr If::fold() {
+    cond = cond->fold();
+    conseq = conseq->fold();
+    alter = alter->fold();
+    if (isLiteral(cond) || cond->e_type == E_STRING) {
+        return cond->e_type == E_FALSE ? alter : conseq;
+    }
+    return Expr(this);
+}
+
+Expr Cond::fold() {
+    for (auto &clause : clauses) {
+        foldAll(clause);
+    }
+    return Expr(this);
+}
+
+Expr Apply::fold() {
+    rator = rator->fold();
+    foldAll(rand);
+    return Expr(this);
+}
+
+// ============================================================================
+// Definitions, bindings and assignment
+// ============================================================================
+
+Expr Define::fold() {
+    e = e->fold();
+    return Expr(this);
+}
+
+Expr Set::fold() {
+    e = e->fold();
+    return Expr(this);
+}
+
+Expr Lambda::fold() {
+    e = e->fold();
+    return Expr(this);
+}
+
+Expr Let::fold() {
+    for (auto &b : bind) {
+        b.second = b.second->fold();
+    }
+    body = body->fold();
+    return Expr(this);
+}
+
+Expr Letrec::fold() {
+    for (auto &b : bind) {
+        if (b.second.get() != nullptr) { // the slot of an internal define
+            b.second = b.second->fold();
+        }
+    }
+    body = body->fold();
+    return Expr(this);
+}
@@ -0,0 +1,26 @@
+#ifndef FOLD
+#define FOLD
+
+/**
+ * @file fold.hpp
+ * @brief Constant folding over parsed expression trees
+ *
+ * Runs between parsing and resolution. A primitive node with no side effects
+ * whose operands are all literals is evaluated once and replaced by the
+ * literal of its value; an if whose test is a literal becomes the branch it
+ * selects; a begin loses the subexpressions before its last that can have no
+ * effect. Shadowing needs no check here: the parser only builds a primitive
+ * node when the name is not bound, and folding computes exactly what that node
+ * would. An operation that fails, such as division by zero, is left in place
+ * to fail at run time, if it is ever reached.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+
+/**
+ * @brief Folds a top-level expression, replacing it if it folds entirely
+ */
+void fold(Expr &);
+
+#endif
@@ -0,0 +1,433 @@
+/**
+ * @file gc.cpp
+ * @brief Implementation of the mark-sweep collector
+ *
+ * Small objects (pairs, boxes, frames of a few slots) are carved from slabs:
+ * aligned blocks of equal-sized cells, one set of slabs per size class and
+ * kind. A fresh slab is handed out by bumping an index; cells freed by a
+ * sweep are threaded onto a free list that is used before the bump. A bitmap
+ * in the slab header tells which cells hold objects, and the owning slab of
+ * any address is found by masking.
+ *
+ * Larger objects come from operator new with one record per allocation, in
+ * allocation order. The stack scan gathers the words that fall inside the
+ * heap's address range and sorts those, so each record is checked against
+ * them by binary search; the stack is far smaller than the heap. Mark bits
+ * live in the objects themselves.
+ */
+
+#include "gc.hpp"
+#include "value.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <pthread.h>
+
+// Allocation between collections never drops below this, so small heaps are not collected constantly
+static const size_t GC_MIN_HEAP = 8 << 20;
+
+static const size_t SLAB_BYTES = 64 << 10;   // Slabs are this size and aligned to it
+static const size_t CELL_ALIGN = 16;         // Size classes are multiples of this
+static const size_t SIZE_CLASSES = 4;        // 16, 32, 48 and 64 bytes
+static const size_t GC_KINDS = 2;
+
+namespace {
+
+struct Record {
+    char *start;
+    size_t size;
+    GcKind kind;
+};
+
+/**
+ * @brief Header at the start of each slab, followed by its cells
+ */
+struct Slab {
+    size_t cell_size;
+    GcKind kind;
+    size_t capacity;    ///< Number of cells
+    size_t used;        ///< Cells [0, used) have been handed out at least once
+    uint64_t live[SLAB_BYTES / CELL_ALIGN / 64]; ///< One bit per cell holding an object
+
+    char *cells();
+    char *cell(size_t i) { return cells() + i * cell_size; }
+    bool isLive(size_t i) const { return (live[i / 64] >> (i % 64)) & 1; }
+    void setLive(size_t i) { live[i / 64] |= uint64_t(1) << (i % 64); }
+    void clearLive(size_t i) { live[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+};
+
+const size_t SLAB_HEADER = (sizeof(Slab) + CELL_ALIGN - 1) / CELL_ALIGN * CELL_ALIGN;
+
+char *Slab::cells() {
+    return reinterpret_cast<char *>(this) + SLAB_HEADER;
+}
+
+/**
+ * @brief Allocation state of one size class of one kind
+ */
+struct SizeClass {
+    void *free_list;    ///< Free cells, linked through their first word
+    Slab *current;      ///< Slab being bump-allocated, null before the first
+};
+
+std::vector<Record> records;        ///< One per live large allocation
+std::vector<Slab *> slabs;          ///< Every slab, in address order
+SizeClass classes[GC_KINDS][SIZE_CLASSES] = {};
+uintptr_t heap_low = UINTPTR_MAX;   ///< Bounds of every address ever allocated
+uintptr_t heap_high = 0;
+std::vector<uintptr_t> stack_words; ///< Candidate pointers found by the stack scan
+size_t allocated_since = 0;         ///< Bytes allocated since the last collection
+size_t threshold = GC_MIN_HEAP;
+GcStats stats = {};
+
+std::vector<ValueBase *> gray_values; ///< Marked, children not yet traced
+std::vector<Frame *> gray_frames;
+
+GcRoot *&rootList() {
+    static GcRoot *head = nullptr;
+    return head;
+}
+
+void noteRange(void *p, size_t size) {
+    heap_low = std::min(heap_low, reinterpret_cast<uintptr_t>(p));
+    heap_high = std::max(heap_high, reinterpret_cast<uintptr_t>(p) + size);
+}
+
+Slab *slabOf(uintptr_t address) {
+    return reinterpret_cast<Slab *>(address & ~(SLAB_BYTES - 1));
+}
+
+// The slab containing an address, or null if it is not in one
+Slab *findSlab(uintptr_t address) {
+    Slab *s = slabOf(address);
+    auto it = std::lower_bound(slabs.begin(), slabs.end(), s);
+    return it != slabs.end() && *it == s ? s : nullptr;
+}
+
+SizeClass &classOf(const Slab *s) {
+    return classes[s->kind][s->cell_size / CELL_ALIGN - 1];
+}
+
+Slab *newSlab(size_t cell_size, GcKind kind) {
+    void *mem = nullptr;
+    if (posix_memalign(&mem, SLAB_BYTES, SLAB_BYTES) != 0) {
+        throw std::bad_alloc();
+    }
+    Slab *s = static_cast<Slab *>(mem);
+    s->cell_size = cell_size;
+    s->kind = kind;
+    s->capacity = (SLAB_BYTES - SLAB_HEADER) / cell_size;
+    s->used = 0;
+    std::fill(std::begin(s->live), std::end(s->live), 0);
+    slabs.insert(std::upper_bound(slabs.begin(), slabs.end(), s), s);
+    noteRange(mem, SLAB_BYTES);
+    return s;
+}
+
+void *allocateCell(size_t size, GcKind kind) {
+    size_t cell_size = (size + CELL_ALIGN - 1) / CELL_ALIGN * CELL_ALIGN;
+    SizeClass &sc = classes[kind][cell_size / CELL_ALIGN - 1];
+    char *p;
+    if (sc.free_list != nullptr) {
+        p = static_cast<char *>(sc.free_list);
+        sc.free_list = *static_cast<void **>(sc.free_list);
+    } else {
+        if (sc.current == nullptr || sc.current->used == sc.current->capacity) {
+            sc.current = newSlab(cell_size, kind);
+        }
+        p = sc.current->cell(sc.current->used++);
+    }
+    Slab *s = slabOf(reinterpret_cast<uintptr_t>(p));
+    s->setLive((p - s->cells()) / cell_size);
+    allocated_since += cell_size;
+    stats.allocated_bytes += cell_size;
+    return p;
+}
+
+void freeCell(Slab *s, void *p) {
+    s->clearLive((static_cast<char *>(p) - s->cells()) / s->cell_size);
+    SizeClass &sc = classOf(s);
+    *static_cast<void **>(p) = sc.free_list;
+    sc.free_list = p;
+}
+
+void markObject(char *start, GcKind kind) {
+    if (kind == GC_VALUE) {
+        gcMark(Value(reinterpret_cast<ValueBase *>(start)));
+    } else {
+        gcMark(reinterpret_cast<Frame *>(start));
+    }
+}
+
+char *stackTop() {
+    static char *top = nullptr;
+    if (top == nullptr) {
+        pthread_attr_t attr;
+        void *addr;
+        size_t size;
+        pthread_getattr_np(pthread_self(), &attr);
+        pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        top = static_cast<char *>(addr) + size;
+    }
+    return top;
+}
+
+// Reads memory the compiler considers dead or out of bounds, which is the point
+__attribute__((noinline, no_sanitize_address))
+void scanRange(const uintptr_t *lo, const uintptr_t *hi) {
+    for (const uintptr_t *p = lo; p < hi; ++p) {
+        uintptr_t word = *p; // copied here: push_back's reference would be read by instrumented code
+        if (word >= heap_low && word < heap_high) {
+            stack_words.push_back(word);
+        }
+    }
+}
+
+// Marks every object that some stack word points into
+void markFromStack() {
+    std::sort(stack_words.begin(), stack_words.end());
+    for (uintptr_t word : stack_words) {
+        Slab *s = findSlab(word);
+        if (s == nullptr || word < reinterpret_cast<uintptr_t>(s->cells())) {
+            continue;
+        }
+        size_t i = (word - reinterpret_cast<uintptr_t>(s->cells())) / s->cell_size;
+        if (i < s->used && s->isLive(i)) {
+            markObject(s->cell(i), s->kind);
+        }
+    }
+    for (const Record &r : records) {
+        uintptr_t start = reinterpret_cast<uintptr_t>(r.start);
+        auto it = std::lower_bound(stack_words.begin(), stack_words.end(), start);
+        if (it != stack_words.end() && *it < start + r.size) {
+            markObject(r.start, r.kind);
+        }
+    }
+    stack_words.clear();
+}
+
+// Callee-saved registers are spilled into the jmp_buf, which lies inside the scanned range
+__attribute__((noinline))
+void scanStack() {
+    jmp_buf registers;
+    setjmp(registers);
+    uintptr_t here = 0;
+    const uintptr_t *lo = &here;
+    scanRange(lo, reinterpret_cast<const uintptr_t *>(stackTop()));
+    scanRange(reinterpret_cast<const uintptr_t *>(&registers),
+              reinterpret_cast<const uintptr_t *>(&registers + 1));
+}
+
+void drain() {
+    while (!gray_values.empty() || !gray_frames.empty()) {
+        if (!gray_values.empty()) {
+            ValueBase *v = gray_values.back();
+            gray_values.pop_back();
+            v->trace();
+        } else {
+            Frame *f = gray_frames.back();
+            gray_frames.pop_back();
+            Value *slots = f->slots();
+            for (int i = 0; i < f->size; ++i) {
+                gcMark(slots[i]);
+            }
+            gcMark(f->parent.get());
+        }
+    }
+}
+
+// Clears the mark of a reachable object and destroys an unreachable one; true if it survives
+bool survives(char *start, GcKind kind) {
+    bool marked;
+    if (kind == GC_VALUE) {
+        ValueBase *v = reinterpret_cast<ValueBase *>(start);
+        marked = v->marked;
+        v->marked = false;
+        if (!marked) {
+            v->~ValueBase();
+        }
+    } else {
+        Frame *f = reinterpret_cast<Frame *>(start);
+        marked = f->marked;
+        f->marked = false;
+        if (!marked) {
+            f->~Frame();
+        }
+    }
+    return marked;
+}
+
+void sweep() {
+    size_t live_objects = 0;
+    size_t live_bytes = 0;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        Record r = records[i];
+        if (survives(r.start, r.kind)) {
+            records[kept++] = r;
+            ++live_objects;
+            live_bytes += r.size;
+        } else {
+            ::operator delete(r.start);
+            ++stats.freed_objects;
+        }
+    }
+    records.resize(kept);
+
+    // free lists are rebuilt from scratch; a slab left empty goes back to the system
+    for (auto &per_kind : classes) {
+        for (SizeClass &sc : per_kind) {
+            sc.free_list = nullptr;
+        }
+    }
+    kept = 0;
+    for (size_t k = 0; k < slabs.size(); ++k) {
+        Slab *s = slabs[k];
+        SizeClass &sc = classOf(s);
+        void *head = nullptr;
+        void **tail = nullptr;
+        size_t live = 0;
+        for (size_t i = s->used; i-- > 0;) {
+            char *cell = s->cell(i);
+            if (s->isLive(i)) {
+                if (survives(cell, s->kind)) {
+                    ++live;
+                    continue;
+                }
+                s->clearLive(i);
+                ++stats.freed_objects;
+            }
+            *reinterpret_cast<void **>(cell) = head;
+            head = cell;
+            if (tail == nullptr) {
+                tail = reinterpret_cast<void **>(cell);
+            }
+        }
+        if (live == 0 && s != sc.current) {
+            free(s);
+            continue;
+        }
+        if (tail != nullptr) {
+            *tail = sc.free_list;
+            sc.free_list = head;
+        }
+        slabs[kept++] = s;
+        live_objects += live;
+        live_bytes += live * s->cell_size;
+    }
+    slabs.resize(kept);
+
+    stats.live_objects = live_objects;
+    stats.live_bytes = live_bytes;
+}
+
+} // namespace
+
+GcRoot::GcRoot() : prev(nullptr), next(rootList()) {
+    if (next != nullptr) {
+        next->prev = this;
+    }
+    rootList() = this;
+}
+
+GcRoot::~GcRoot() {
+    if (prev != nullptr) {
+        prev->next = next;
+    } else {
+        rootList() = next;
+    }
+    if (next != nullptr) {
+        next->prev = prev;
+    }
+}
+
+RootedValues::RootedValues(const std::vector<Value> &values) : values(values) {}
+
+void RootedValues::trace() {
+    for (const Value &v : values) {
+        gcMark(v);
+    }
+}
+
+void RootedValue::trace() {
+    gcMark(v);
+}
+
+void gcMark(const Value &v) {
+    ValueBase *p = v.get();
+    if (p != nullptr && !p->marked) {
+        p->marked = true;
+        gray_values.push_back(p);
+    }
+}
+
+void gcMark(Frame *f) {
+    if (f != nullptr && !f->marked) {
+        f->marked = true;
+        gray_frames.push_back(f);
+    }
+}
+
+void *gcAllocate(size_t size, GcKind kind) {
+    if (allocated_since >= threshold) {
+        gcCollect();
+    }
+    ++stats.allocations;
+    size_t depth = stackTop() - static_cast<char *>(__builtin_frame_address(0));
+    if (depth > stats.max_stack_bytes) {
+        stats.max_stack_bytes = depth;
+    }
+    if (size <= SIZE_CLASSES * CELL_ALIGN) {
+        return allocateCell(size, kind);
+    }
+    void *p = ::operator new(size);
+    records.push_back(Record{static_cast<char *>(p), size, kind});
+    noteRange(p, size);
+    allocated_since += size;
+    stats.allocated_bytes += size;
+    return p;
+}
+
+void gcForget(void *p) {
+    Slab *s = findSlab(reinterpret_cast<uintptr_t>(p));
+    if (s != nullptr) {
+        freeCell(s, p);
+        return;
+    }
+    for (size_t i = records.size(); i-- > 0;) {
+        if (records[i].start == p) {
+            records.erase(records.begin() + i);
+            break;
+        }
+    }
+    ::operator delete(p);
+}
+
+void gcCollect() {
+    auto start = std::chrono::steady_clock::now();
+
+    for (GcRoot *r = rootList(); r != nullptr; r = r->next) {
+        r->trace();
+    }
+    scanStack();
+    markFromStack();
+    drain();
+    sweep();
+
+    allocated_since = 0;
+    threshold = std::max(GC_MIN_HEAP, stats.live_bytes);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ++stats.collections;
+    stats.total_pause_ms += ms;
+    stats.max_pause_ms = std::max(stats.max_pause_ms, ms);
+}
+
+const GcStats &gcStats() {
+    return stats;
+}
@@ -0,0 +1,80 @@
+#ifndef GC
+#define GC
+
+/**
+ * @file gc.hpp
+ * @brief Mark-sweep garbage collector for heap values and activation frames
+ *
+ * Every ValueBase and every Frame is allocated through the collector, and a
+ * Value or Env is a plain word that is copied without bookkeeping. A
+ * collection marks everything reachable from the roots and frees the rest, so
+ * cycles (a recursive procedure and the frame that binds it, a list closed by
+ * set-cdr!) are reclaimed like any other garbage.
+ *
+ * The roots are the native stack and registers, scanned conservatively (a
+ * word that points anywhere into an object keeps it alive), and every live
+ * GcRoot. A Value kept in memory the stack scan cannot see (a std::vector, a
+ * static table, the VM's stacks) must be reachable from a GcRoot while an
+ * allocation can happen.
+ *
+ * Collections happen only inside gcAllocate, once the bytes allocated since
+ * the previous one exceed what that collection left live. Constructors of
+ * collected objects must not allocate collected objects themselves.
+ */
+
+#include "Def.hpp"
+#include <cstddef>
+#include <vector>
+
+enum GcKind { GC_VALUE, GC_FRAME };
+
+void *gcAllocate(size_t, GcKind);
+void gcForget(void *);          ///< Releases an allocation whose constructor threw
+void gcCollect();
+
+// Called from trace methods and GcRoot::trace to report a reference
+void gcMark(const Value &);
+void gcMark(Frame *);
+
+/**
+ * @brief Registers extra roots for as long as the object exists
+ *
+ * Instances link themselves into a list on construction and unlink on
+ * destruction, so a GcRoot can be a static or a local guarding a container.
+ */
+struct GcRoot {
+    GcRoot *prev;
+    GcRoot *next;
+    GcRoot();
+    GcRoot(const GcRoot &) = delete;
+    GcRoot &operator=(const GcRoot &) = delete;
+    virtual ~GcRoot();
+    virtual void trace() = 0;
+};
+
+/**
+ * @brief Keeps the contents of a vector of Values alive
+ */
+struct RootedValues : GcRoot {
+    const std::vector<Value> &values;
+    explicit RootedValues(const std::vector<Value> &);
+    virtual void trace() override;
+};
+
+/**
+ * @brief Collector activity since startup
+ */
+struct GcStats {
+    size_t collections;
+    double total_pause_ms;
+    double max_pause_ms;
+    size_t allocations;         ///< Objects ever allocated
+    size_t allocated_bytes;     ///< Total ever requested
+    size_t freed_objects;
+    size_t live_objects;        ///< Objects surviving the last collection
+    size_t live_bytes;
+    size_t max_stack_bytes;     ///< Deepest native stack seen at an allocation
+};
+const GcStats &gcStats();
+
+#endif
@@ -2,10 +2,20 @@
 #include "syntax.hpp"
 #include "expr.hpp"
 #include "value.hpp"
+#include "fold.hpp"
+#include "resolve.hpp"
+#include "source.hpp"
+#include "output.hpp"
+#include "profile.hpp"
+#include "stats.hpp"
+#include "vm.hpp"
+#include "gc.hpp"
+#include "arena.hpp"
 #include "RE.hpp"
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unistd.h>
 
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
@@ -19,7 +29,7 @@ bool isExplicitVoidCall(Expr expr) {
     Apply* apply_expr = dynamic_cast<Apply*>(expr.get());
     if (apply_expr != nullptr) {
         Var* var_expr = dynamic_cast<Var*>(apply_expr->rator.get());
-        if (var_expr != nullptr && var_expr->x == "void") {
+        if (var_expr != nullptr && var_expr->x.str() == "void") {
             return true;
         }
     }
@@ -45,59 +55,154 @@ bool isExplicitVoidCall(Expr expr) {
     return false;
 }
 
+static bool use_vm = false; // --vm: run forms on the bytecode VM instead of the tree walker
+static bool gc_stats = false; // --gc-stats: report collector activity on stderr at exit
+static bool print_stats = false; // --stats: report the runtime counters on stderr at exit
+
+static void printGcStats() {
+    const GcStats &s = gcStats();
+    std::cerr << "gc: " << s.collections << " collections, "
+              << s.total_pause_ms << " ms total pause, "
+              << s.max_pause_ms << " ms max pause, "
+              << s.freed_objects << " objects freed, "
+              << s.live_objects << " live (" << s.live_bytes << " bytes) after the last collection, "
+              << s.allocations << " objects (" << s.allocated_bytes << " bytes) allocated, "
+              << s.max_stack_bytes << " bytes of stack at the deepest allocation" << std::endl;
+}
+
+// Parses, runs and prints one top-level form; false once it asked to exit
+static bool runForm(const Syntax &stx) {
+    try{
+        Assoc scope = empty(); // names bound at top level are found in the global table
+        Expr expr = stx -> parse(scope);
+        fold(expr);
+        resolve(expr);
+        Env top_env; // top-level forms have no local bindings
+        Value val = use_vm ? execute(expr) : expr -> eval(top_env);
+
+        if (val.type() == V_TERMINATE)
+            return false;
+
+        if (!val.unset()) {
+            if (val.type() != V_VOID_DEFINE) {
+                val.show(out());
+                out() << '\n';
+            } else {
+                // 【修改建议】
+                // 如果是 define，虽然不打印值，但为了视觉整洁，
+                // 你可以在这里打印一个换行符，这样下一个 scm> 就会在新的一行。
+                // 如果你不希望有空行，就删掉下面这行，但必须接受 scm> "A" 的现象。
+                // puts("");
+            }
+        }
+    }
+    catch (const RuntimeError &RE){
+        //std :: cout << RE.message();
+        out() << "RuntimeError\n"; // 你的输出示例里这里没有换行，可能会导致粘连
+    }
+    return true;
+}
+
 void REPL(){
-    Assoc global_env = empty();
     while (1){
 #ifndef ONLINE_JUDGE
-        std::cout << "scm> ";
-        std::cout.flush(); // 确保提示符在读取输入前被打印出来
+        out() << "scm> ";
+        flushBeforeInput(); // 确保提示符在读取输入前被打印出来
 #endif
 
         // ... read and parse ...
+        Arena form; // this form's syntax and expression nodes, freed together at the end of the iteration
+        ArenaScope building(form);
         Syntax stx = readSyntax(std :: cin);
 
         // 增加一个检查：如果读到了文件流结束(EOF)，直接退出
         // 这样可以防止最后多打印一个 scm>
         if (!std::cin) break;
 
-        try{
-            Expr expr = stx -> parse(global_env);
-            Value val = expr -> eval(global_env);
-
-            if (val -> v_type == V_TERMINATE)
-                break;
-
-            if (val.get()) {
-                if (val->v_type != V_VOID_DEFINE) {
-                    val->show(std::cout);
-                    puts("");
-                } else {
-                    // 【修改建议】
-                    // 如果是 define，虽然不打印值，但为了视觉整洁，
-                    // 你可以在这里打印一个换行符，这样下一个 scm> 就会在新的一行。
-                    // 如果你不希望有空行，就删掉下面这行，但必须接受 scm> "A" 的现象。
-                    // puts("");
-                }
-            }
-        }
-        catch (const RuntimeError &RE){
-            //std :: cout << RE.message();
-            std :: cout << "RuntimeError"; // 你的输出示例里这里没有换行，可能会导致粘连
-            puts("");
-
-            // 发生错误后，清理输入流是个好习惯
-            if (std::cin.peek() == '\n') std::cin.get();
-        }
+        if (!runForm(stx)) break;
 
         // 吃掉残留换行符（正如上一个回答提到的，这对交互体验很重要）
         while (std::cin.peek() == '\n' || std::cin.peek() == ' ' || std::cin.peek() == '\r') {
             std::cin.get();
         }
+
+        if (form.retained()) {
+            codeArena().adopt(form);
+        }
+    }
+}
+
+// Runs every form of a script with no prompts; output matches the REPL's with the prompts removed
+static void runSource(Source &src) {
+    while (1){
+        Arena form;
+        ArenaScope building(form);
+        Syntax stx = readSyntax(src);
+        if (stx.get() == nullptr) break;
+
+        if (!runForm(stx)) break;
+
+        if (form.retained()) {
+            codeArena().adopt(form);
+        }
     }
 }
 
 
 int main(int argc, char *argv[]) {
-    REPL();
+    std::string script; // code FILE, or code - for standard input, runs a script instead of the REPL
+    // --flush=line|full|explicit; a terminal session sees each line at once, anything else is written in blocks
+    FlushPolicy flush_policy = isatty(0) && isatty(1) ? FLUSH_LINE : FLUSH_FULL;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--vm") {
+            use_vm = true;
+        } else if (std::string(argv[i]) == "--gc-stats") {
+            gc_stats = true;
+        } else if (std::string(argv[i]) == "--stats") {
+            print_stats = true;
+        } else if (std::string(argv[i]) == "--profile") { // per-procedure time and calls on stderr at exit
+            enableProfiling();
+        } else if (std::string(argv[i]).compare(0, 8, "--flush=") == 0) {
+            std::string policy = argv[i] + 8;
+            if (policy == "line") {
+                flush_policy = FLUSH_LINE;
+            } else if (policy == "full") {
+                flush_policy = FLUSH_FULL;
+            } else if (policy == "explicit") {
+                flush_policy = FLUSH_EXPLICIT;
+            } else {
+                std::cerr << "unknown flush policy: " << policy << std::endl;
+                return 1;
+            }
+        } else {
+            script = argv[i];
+        }
+    }
+    if (use_vm && profiling()) {
+        std::cerr << "--profile times the tree walker and cannot be used with --vm" << std::endl;
+        return 1;
+    }
+    setFlushPolicy(flush_policy);
+    if (script.empty()) {
+        REPL();
+    } else {
+        try {
+            Source src(script);
+            runSource(src);
+        } catch (const RuntimeError &RE) {
+            std::cerr << RE.message() << std::endl;
+            return 1;
+        }
+    }
+    flushOutput();
+    if (gc_stats) {
+        printGcStats();
+    }
+    if (print_stats) {
+        printRuntimeStats(std::cerr);
+    }
+    if (profiling()) {
+        printProfile(std::cerr);
+    }
     return 0;
 }
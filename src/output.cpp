@@ -0,0 +1,97 @@
+/**
+ * @file output.cpp
+ * @brief Implementation of the buffered standard output
+ */
+
+#include "output.hpp"
+#include <cerrno>
+#include <cstring>
+#include <streambuf>
+#include <string>
+#include <unistd.h>
+
+static const size_t BUFFER_BYTES = 1 << 16;
+
+/**
+ * @brief Collects output and writes it to file descriptor 1 as the policy allows
+ *
+ * The stream's own put area is left empty, so every write arrives through
+ * xsputn or overflow and the policy can look at it.
+ */
+class OutputBuffer : public std::streambuf {
+public:
+    OutputBuffer() : policy(FLUSH_FULL) { pending.reserve(BUFFER_BYTES); }
+    ~OutputBuffer() { drain(); }
+
+    void setPolicy(FlushPolicy p) {
+        drain();
+        policy = p;
+    }
+    FlushPolicy getPolicy() const { return policy; }
+
+    void drain() {
+        const char *p = pending.data();
+        size_t left = pending.size();
+        while (left > 0) {
+            ssize_t n = write(1, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break; // nowhere to report it; the output is dropped
+            }
+            p += n;
+            left -= n;
+        }
+        pending.clear();
+    }
+
+protected:
+    virtual int overflow(int c) override {
+        if (c != traits_type::eof()) {
+            char ch = (char)c;
+            xsputn(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char *s, std::streamsize n) override {
+        pending.append(s, n);
+        if (policy == FLUSH_LINE ? memchr(s, '\n', n) != nullptr
+                                 : policy == FLUSH_FULL && pending.size() >= BUFFER_BYTES) {
+            drain();
+        }
+        return n;
+    }
+
+    virtual int sync() override {
+        drain();
+        return 0;
+    }
+
+private:
+    std::string pending;
+    FlushPolicy policy;
+};
+
+static OutputBuffer &buffer() {
+    static OutputBuffer b;
+    return b;
+}
+
+std::ostream &out() {
+    static std::ostream os(&buffer());
+    return os;
+}
+
+void setFlushPolicy(FlushPolicy p) {
+    buffer().setPolicy(p);
+}
+
+void flushOutput() {
+    buffer().drain();
+}
+
+void flushBeforeInput() {
+    if (buffer().getPolicy() == FLUSH_LINE) {
+        buffer().drain();
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef OUTPUT
+#define OUTPUT
+
+/**
+ * @file output.hpp
+ * @brief The buffered standard output every printer writes to
+ *
+ * display, the REPL's printer and prompt and Value::show all write to out(),
+ * whose buffer goes to file descriptor 1 in large writes. The flush policy
+ * decides when: at each newline, when the buffer fills, or only on
+ * (flush-output) and at exit. Whatever is buffered is written when the
+ * program ends.
+ */
+
+#include <ostream>
+
+enum FlushPolicy {
+    FLUSH_LINE,         ///< After every newline, and before the REPL reads input
+    FLUSH_FULL,         ///< When the buffer fills
+    FLUSH_EXPLICIT,     ///< Only on flush-output and at exit; the buffer grows as needed
+};
+
+std::ostream &out();
+void setFlushPolicy(FlushPolicy);
+void flushOutput();
+
+/**
+ * @brief Called before blocking on input, so a prompt is seen under FLUSH_LINE
+ */
+void flushBeforeInput();
+
+#endif
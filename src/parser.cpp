@@ -12,18 +12,156 @@
 #include "syntax.hpp"
 #include "value.hpp"
 #include "expr.hpp"
+#include "profile.hpp"
 #include <map>
 #include <string>
 #include <iostream>
+#include <algorithm>
 
 #define mp make_pair
 using std::string;
 using std::vector;
 using std::pair;
+using std::make_pair;
 
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
+// Calls made under --profile time the procedures they run; others carry no profiling code
+static Expr makeApply(const vector<Expr> &operands) {
+    vector<Expr> args(operands.begin() + 1, operands.end());
+    if (profiling()) {
+        return Expr(new ProfiledApply(operands[0], args));
+    }
+    return Expr(new Apply(operands[0], args));
+}
+
+/**
+ * @brief Whether name is a variable here, which hides any keyword or primitive
+ *
+ * env only holds the local names in scope; top-level names live in the
+ * global table.
+ */
+static bool isBound(Sym name, Assoc &env) {
+    return !find(name, env).unset() || findGlobal(name) != nullptr;
+}
+
+/**
+ * @brief Collects the names defined by a body form, looking inside begin
+ *
+ * Only forms whose head still means define/begin in env are considered.
+ */
+static void collectDefines(const Syntax &stx, Assoc &env, vector<Sym> &names) {
+    auto lst = dynamic_cast<List*>(stx.get());
+    if (lst == nullptr || lst->stxs.empty()) {
+        return;
+    }
+    auto head = dynamic_cast<SymbolSyntax*>(lst->stxs[0].get());
+    if (head == nullptr || isBound(head->s, env)) {
+        return;
+    }
+    if (head->s.str() == "begin") {
+        for (size_t i = 1; i < lst->stxs.size(); ++i) {
+            collectDefines(lst->stxs[i], env, names);
+        }
+        return;
+    }
+    if (head->s.str() != "define" || lst->stxs.size() < 2) {
+        return;
+    }
+    Sym name;
+    if (auto sym = dynamic_cast<SymbolSyntax*>(lst->stxs[1].get())) {
+        name = sym->s;
+    } else if (auto sig = dynamic_cast<List*>(lst->stxs[1].get())) {
+        if (!sig->stxs.empty()) {
+            if (auto fname = dynamic_cast<SymbolSyntax*>(sig->stxs[0].get())) {
+                name = fname->s;
+            }
+        }
+    }
+    if (name != Sym() && std::find(names.begin(), names.end(), name) == names.end()) {
+        names.push_back(name);
+    }
+}
+
+/**
+ * @brief Parses stxs[from..] as the body of a lambda, let or letrec
+ *
+ * Internal defines behave like letrec*: the body runs inside a Letrec whose
+ * bindings have no initializer, and each Define fills its own slot in order.
+ */
+static Expr parseBody(const vector<Syntax> &stxs, size_t from, Assoc &env) {
+    if (from >= stxs.size()) {
+        throw RuntimeError("body requires at least one expression");
+    }
+
+    vector<Sym> names;
+    for (size_t i = from; i < stxs.size(); ++i) {
+        collectDefines(stxs[i], env, names);
+    }
+    Assoc body_env = env;
+    for (auto &name : names) {
+        body_env = extend(name, VoidV(), body_env);
+    }
+
+    vector<Expr> es;
+    for (size_t i = from; i < stxs.size(); ++i) {
+        es.push_back(stxs[i]->parse(body_env));
+    }
+    Expr body = es.size() == 1 ? es[0] : Expr(new Begin(es));
+    if (names.empty()) {
+        return body;
+    }
+
+    vector<pair<Sym, Expr>> slots;
+    for (auto &name : names) {
+        slots.push_back(mp(name, Expr(nullptr)));
+    }
+    return Expr(new Letrec(slots, body));
+}
+
+/**
+ * @brief Parses a list of symbols, such as lambda parameters
+ */
+static vector<Sym> parseParams(const Syntax &stx, size_t from, const string &what) {
+    auto pList = dynamic_cast<List*>(stx.get());
+    if (!pList) {
+        throw RuntimeError(what + " parameter list must be a list");
+    }
+    vector<Sym> params;
+    for (size_t i = from; i < pList->stxs.size(); ++i) {
+        auto psym = dynamic_cast<SymbolSyntax*>(pList->stxs[i].get());
+        if (!psym) {
+            throw RuntimeError(what + " parameter must be a symbol");
+        }
+        params.push_back(psym->s);
+    }
+    return params;
+}
+
+/**
+ * @brief Parses the ((name init) ...) list of let and letrec
+ */
+static vector<pair<Sym, Syntax>> parseBindings(const Syntax &stx, const string &what) {
+    auto bList = dynamic_cast<List*>(stx.get());
+    if (!bList) {
+        throw RuntimeError(what + " bindings must be a list");
+    }
+    vector<pair<Sym, Syntax>> binds;
+    for (auto &b : bList->stxs) {
+        auto pr = dynamic_cast<List*>(b.get());
+        if (!pr || pr->stxs.size() != 2) {
+            throw RuntimeError(what + " binding must be a (name value) pair");
+        }
+        auto sym = dynamic_cast<SymbolSyntax*>(pr->stxs[0].get());
+        if (!sym) {
+            throw RuntimeError(what + " binding name must be a symbol");
+        }
+        binds.push_back(mp(sym->s, pr->stxs[1]));
+    }
+    return binds;
+}
+
 /**
  * @brief Default parse method (should be overridden by subclasses)
  */
@@ -35,12 +173,78 @@ Expr Number::parse(Assoc &env) {
     return Expr(new Fixnum(n));
 }
 
+Expr BigNumber::parse(Assoc &env) {
+    return Expr(new Bignum(n));
+}
+
 Expr RationalSyntax::parse(Assoc &env) {
     return Expr(new RationalNum(numerator , denominator));
     //TODO: complete the rational parser
 }
 
+// Depends only on the spelling, so it runs once here rather than on every lookup
+static void checkVariableName(const std::string &name) {
+    if (name.empty() || (isdigit(name[0]) || name[0] == '.' || name[0] == '@')) {
+        throw RuntimeError("Invalid variable name: starts with invalid character");
+    }
+
+    const std::string forbidden_chars = "#'\"`";
+    for (char c : name) {
+        if (forbidden_chars.find(c) != std::string::npos) {
+            throw RuntimeError("Invalid variable name: contains forbidden character '" + std::string(1, c) + "'");
+        }
+    }
+
+    auto isNumeric = [](const std::string &s) -> bool {
+        if (s.empty())
+            return false;
+        size_t i = 0;
+        if (s[i] == '+' || s[i] == '-')
+            i++; // Sign
+        bool has_digit = false;
+        bool has_dot = false;
+        bool has_exponent = false;
+        while (i < s.size()) {
+            if (isdigit(s[i])) {
+                has_digit = true;
+            } else if (s[i] == '.') {
+                if (has_dot || has_exponent)
+                    return false;
+                has_dot = true;
+            } else if (s[i] == 'e' || s[i] == 'E') {
+                if (has_exponent || !has_digit)
+                    return false;
+                has_exponent = true;
+                if (++i >= s.size() || (!isdigit(s[i]) && s[i] != '+' && s[i] != '-')) {
+                    return false;
+                }
+                if (s[i] == '+' || s[i] == '-')
+                    i++;
+                if (i >= s.size() || !isdigit(s[i]))
+                    return false;
+            } else {
+                return false;
+            }
+            i++;
+        }
+        // Must have at least one digit (reject "." or "+.")
+        return has_digit;
+    };
+
+    if (isNumeric(name)) {
+        throw RuntimeError("Invalid variable name: numeric format is prioritized as literal");
+    }
+    // TODO: TO identify the invalid variable
+    // We request all valid variable just need to be a symbol,you should promise:
+    //The first character of a variable name cannot be a digit or any character from the set: {.@}
+    //If a string can be recognized as a number, it will be prioritized as a number. For example: 1, -1, +123, .123, +124., 1e-3
+    //Variable names can overlap with primitives and reserve_words
+    //Variable names can contain any non-whitespace characters except #, ', ", `, but the first character cannot be a digit
+    //When a variable is not defined in the current scope, your interpreter should output RuntimeError
+}
+
 Expr SymbolSyntax::parse(Assoc &env) {
+    checkVariableName(s.str());
     return Expr(new Var(s));
 }
 
@@ -71,16 +275,16 @@ Expr List::parse(Assoc &env) {
         for (auto & s : stxs) {
             operands.emplace_back(s->parse(env));
         }
-        return Expr(new Apply(operands[0] , vector<Expr>(operands.begin()+1 , operands.end())));
+        return makeApply(operands);
         //TODO: TO COMPLETE THE LOGIC
     }else{
-    string op = id->s;
-    if (find(op, env).get() != nullptr) {
+    string op = id->s.str();
+    if (isBound(id->s, env)) {
         vector<Expr> operands;
         for (auto & s : stxs) {
             operands.emplace_back(s->parse(env));
         }
-        return Expr(new Apply(operands[0] , vector<Expr>(operands.begin()+1 , operands.end())));
+        return makeApply(operands);
         //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
     }
     if (primitives.count(op) != 0) {
@@ -89,12 +293,10 @@ Expr List::parse(Assoc &env) {
             parameters.emplace_back(stxs[i]->parse(env));
         }
         //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
-        auto v1 = Expr (new RationalNum(1,1));
-    	auto v0 = Expr (new RationalNum(0,1));
         ExprType op_type = primitives[op];
         if (op_type == E_PLUS) {
             if (parameters.size() == 0)
-                return Expr(new Plus(v0,v0));
+                return Expr(new Fixnum(0));
         	if (parameters.size() == 1) {
         		return parameters[0];
         	}
@@ -107,12 +309,12 @@ Expr List::parse(Assoc &env) {
             if (parameters.size() == 2)
                 return Expr(new Minus(parameters[0] , parameters[1]));
         	if (parameters.size() == 1) {
-        		return Expr(new Minus(v0 , parameters[0]));
+        		return Expr(new Minus(Expr(new Fixnum(0)) , parameters[0]));
         	}
             return Expr(new MinusVar(parameters));
         } else if (op_type == E_MUL) {
             if (parameters.size() == 0)
-            	return Expr(new Mult(v1,v1));
+            	return Expr(new Fixnum(1));
             if (parameters.size() == 2)
                 return Expr(new Mult(parameters[0] , parameters[1]));
         	if (parameters.size() == 1) {
@@ -125,7 +327,7 @@ Expr List::parse(Assoc &env) {
             if (parameters.size() == 2)
                 return Expr(new Div(parameters[0] , parameters[1]));
         	if (parameters.size() == 1) {
-        		return Expr(new Div(v1 , parameters[0]));
+        		return Expr(new Div(Expr(new Fixnum(1)) , parameters[0]));
         	}
             return Expr(new DivVar(parameters));
         }  else if (op_type == E_MODULO) {
@@ -174,6 +376,22 @@ Expr List::parse(Assoc &env) {
             return Expr(new AndVar(parameters));
         } else if (op_type == E_OR) {
             return Expr(new OrVar(parameters));
+        }else if (op_type == E_NOT) {
+        	if (parameters.size() != 1)
+        		throw RuntimeError("not requires exactly 1 argument");
+        	return Expr(new Not(parameters[0]));
+        }else if (op_type == E_EXPT) {
+        	if (parameters.size() != 2)
+        		throw RuntimeError("expt requires exactly 2 argument");
+        	return Expr(new Expt(parameters[0] , parameters[1]));
+        }else if (op_type == E_SETCAR) {
+        	if (parameters.size() != 2)
+        		throw RuntimeError("set-car! requires exactly 2 argument");
+        	return Expr(new SetCar(parameters[0] , parameters[1]));
+        }else if (op_type == E_SETCDR) {
+        	if (parameters.size() != 2)
+        		throw RuntimeError("set-cdr! requires exactly 2 argument");
+        	return Expr(new SetCdr(parameters[0] , parameters[1]));
         }else if (op_type == E_CAR) {
         	if (parameters.size() != 1)
         		throw RuntimeError("car requires exactly 1 argument");
@@ -241,6 +459,14 @@ Expr List::parse(Assoc &env) {
         	if (parameters.size() != 1)
         		throw RuntimeError("Dispaly requires exactly 1 argument");
 	        return Expr(new Display(parameters[0]));
+        }else if (op_type == E_FLUSH) {
+        	if (parameters.size() != 0)
+        		throw RuntimeError("flush-output requires exactly 0 argument");
+	        return Expr(new FlushOutput());
+        }else if (op_type == E_RUNTIME_STATS) {
+        	if (parameters.size() != 0)
+        		throw RuntimeError("runtime-stats requires exactly 0 argument");
+	        return Expr(new RuntimeStatistics());
         }
     	else {
             throw RuntimeError("Unknown primitive operator: " + op);
@@ -294,11 +520,11 @@ Expr List::parse(Assoc &env) {
     	            SyntaxBase *predicateSyntax = clauseList->stxs[0].get();
 
     	            if (auto sym = dynamic_cast<SymbolSyntax*>(predicateSyntax)) {
-    	                if (sym->s == "else") {
+    	                if (sym->s.str() == "else") {
     	                    if (i != stxs.size() - 1) {
     	                        throw RuntimeError("else clause must be the last clause of cond");
     	                    }
-    	                    parsedClause.push_back(Expr(new Var("else")));
+    	                    parsedClause.push_back(Expr(new Var(sym->s)));
     	                } else {
     	                    parsedClause.push_back(predicateSyntax->parse(env));
     	                }
@@ -325,40 +551,29 @@ Expr List::parse(Assoc &env) {
     	            throw RuntimeError("lambda requires parameter list and a body");
     	        }
 
-    	        std::vector<std::string> params;
-
-
-    	        auto pList = dynamic_cast<List*>(stxs[1].get());
-    	        if (!pList) {
-    	            throw RuntimeError("lambda parameter list must be a list");
-    	        }
-
-    	        for (auto &p : pList->stxs) {
-    	            auto psym = dynamic_cast<SymbolSyntax*>(p.get());
-    	            if (!psym) {
-    	                throw RuntimeError("lambda parameter must be a symbol");
-    	            }
-    	            params.push_back(psym->s);
+    	        vector<Sym> params = parseParams(stxs[1], 0, "lambda");
+    	        Assoc body_env = env;
+    	        for (auto &p : params) {
+    	            body_env = extend(p, VoidV(), body_env);
     	        }
-
-
-    	        // std::vector<Expr> bodies;
-    	        // for (size_t i = 2; i < stxs.size(); ++i) {
-    	        //     bodies.push_back(stxs[i]->parse(env));
-    	        // }
-
-
-
-    	    	return Expr(new Lambda(params,stxs[2]->parse(env)));
+    	    	Lambda *lam = new Lambda(params, parseBody(stxs, 2, body_env));
+    	    	lam->line = line;
+    	    	return Expr(lam);
     	    }
     	    case E_DEFINE: {
-    	    	if (stxs.size() != 3) {
+    	    	if (stxs.size() < 3) {
     	    		throw RuntimeError("define need 2 params");
     	    	}
     	    	if (auto sym = dynamic_cast<SymbolSyntax*>(stxs[1].get())) {
-    	    		string varName = sym->s;
+    	    		if (stxs.size() != 3) {
+    	    			throw RuntimeError("define need 2 params");
+    	    		}
+    	    		Sym varName = sym->s;
 
     	    		Expr rhs = stxs[2]->parse(env);
+    	    		if (rhs->e_type == E_LAMBDA && static_cast<Lambda*>(rhs.get())->name == Sym()) {
+    	    			static_cast<Lambda*>(rhs.get())->name = varName;
+    	    		}
 
     	    		return Expr(new Define(varName, rhs));
     	    	}
@@ -374,23 +589,18 @@ Expr List::parse(Assoc &env) {
     	    			throw RuntimeError("function name must be a symbol");
     	    		}
 
-    	    		string funcName = fnameSym->s;
+    	    		Sym funcName = fnameSym->s;
+    	    		vector<Sym> params = parseParams(stxs[1], 1, "lambda");
 
-    	    		vector<string> params;
-    	    		for (size_t i = 1; i < lst->stxs.size(); ++i) {
-    	    			auto psym = dynamic_cast<SymbolSyntax*>(lst->stxs[i].get());
-    	    			if (!psym) {
-    	    				throw RuntimeError("lambda parameter must be symbol");
-    	    			}
-    	    			params.push_back(psym->s);
+    	    		// the body only runs once funcName is bound, so it shadows primitives there
+    	    		Assoc body_env = extend(funcName, VoidV(), env);
+    	    		for (auto &p : params) {
+    	    			body_env = extend(p, VoidV(), body_env);
     	    		}
-
-    	    		// vector<Expr> bodyExprs;
-    	    		// for (size_t i = 2; i < stxs.size(); ++i) {
-    	    		// 	bodyExprs.push_back(stxs[i]->parse(env));
-    	    		// }
-
-    	    		Expr lam = Expr(new Lambda(params, stxs[2]->parse(env)));
+    	    		Lambda *lam_node = new Lambda(params, parseBody(stxs, 2, body_env));
+    	    		lam_node->name = funcName;
+    	    		lam_node->line = line;
+    	    		Expr lam = Expr(lam_node);
 
     	    		return Expr(new Define(funcName, lam));
     	    	}
@@ -398,19 +608,53 @@ Expr List::parse(Assoc &env) {
     	    	throw RuntimeError("malformed define expression");
 	    	    break;
     	    }
-    	    case E_LET:
-    	        break;
-    	    case E_LETREC:
-    	        break;
-    	    case E_SET:
-    	        break;
-			//TODO: TO COMPLETE THE reserve_words PARSER LOGIC
+    	    case E_LET: {
+    	        if (stxs.size() < 3) {
+    	            throw RuntimeError("let requires bindings and a body");
+    	        }
+    	        vector<pair<Sym, Expr>> binds;
+    	        Assoc body_env = env;
+    	        for (auto &b : parseBindings(stxs[1], "let")) {
+    	            binds.push_back(mp(b.first, b.second->parse(env)));
+    	            body_env = extend(b.first, VoidV(), body_env);
+    	        }
+    	        return Expr(new Let(binds, parseBody(stxs, 2, body_env)));
+    	    }
+    	    case E_LETREC: {
+    	        if (stxs.size() < 3) {
+    	            throw RuntimeError("letrec requires bindings and a body");
+    	        }
+    	        auto stx_binds = parseBindings(stxs[1], "letrec");
+    	        Assoc body_env = env;
+    	        for (auto &b : stx_binds) {
+    	            body_env = extend(b.first, VoidV(), body_env);
+    	        }
+    	        vector<pair<Sym, Expr>> binds;
+    	        for (auto &b : stx_binds) {
+    	            binds.push_back(mp(b.first, b.second->parse(body_env)));
+    	        }
+    	        return Expr(new Letrec(binds, parseBody(stxs, 2, body_env)));
+    	    }
+    	    case E_SET: {
+    	        if (stxs.size() != 3) {
+    	            throw RuntimeError("set! requires a variable and a value");
+    	        }
+    	        auto sym = dynamic_cast<SymbolSyntax*>(stxs[1].get());
+    	        if (!sym) {
+    	            throw RuntimeError("set! target must be a symbol");
+    	        }
+    	        return Expr(new Set(sym->s, stxs[2]->parse(env)));
+    	    }
         	default:
             	throw RuntimeError("Unknown reserved word: " + op);
     	}
     }
 
     //default: use Apply to be an expression
-    //TODO: TO COMPLETE THE PARSER LOGIC
+    vector<Expr> operands;
+    for (auto & s : stxs) {
+        operands.emplace_back(s->parse(env));
+    }
+    return makeApply(operands);
 }
 }
@@ -0,0 +1,85 @@
+/**
+ * @file profile.cpp
+ * @brief Implementation of the procedure profiler
+ */
+
+#include "profile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ProfileEntry {
+    std::string name;
+    unsigned long long calls;
+    double inclusive_ns;
+    double exclusive_ns;
+    int active;         ///< Activations on the stack; inclusive time is added when the outermost ends
+};
+
+static bool enabled = false;
+static std::unordered_map<const ExprBase *, ProfileEntry> entries;
+static ProfileScope *innermost = nullptr;
+
+void enableProfiling() {
+    enabled = true;
+}
+
+bool profiling() {
+    return enabled;
+}
+
+static ProfileEntry &entryFor(const ExprBase *body) {
+    auto it = entries.find(body);
+    if (it == entries.end()) {
+        it = entries.insert(std::make_pair(body, ProfileEntry{"lambda", 0, 0, 0, 0})).first;
+    }
+    return it->second;
+}
+
+void profileProcedure(const ExprBase *body, const std::string &name) {
+    entryFor(body).name = name;
+}
+
+ProfileScope::ProfileScope(const ExprBase *body)
+    : entry(&entryFor(body)), start(std::chrono::steady_clock::now()), callees_ns(0), outer(innermost) {
+    ++entry->calls;
+    ++entry->active;
+    innermost = this;
+}
+
+ProfileScope::~ProfileScope() {
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    entry->exclusive_ns += elapsed - callees_ns;
+    if (--entry->active == 0) {
+        entry->inclusive_ns += elapsed;
+    }
+    innermost = outer;
+    if (outer != nullptr) {
+        outer->callees_ns += elapsed;
+    }
+}
+
+void printProfile(std::ostream &os) {
+    std::vector<const ProfileEntry *> sorted;
+    double total_ns = 0;
+    for (auto &e : entries) {
+        if (e.second.calls > 0) {
+            sorted.push_back(&e.second);
+            total_ns += e.second.exclusive_ns;
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const ProfileEntry *a, const ProfileEntry *b) {
+        return a->exclusive_ns > b->exclusive_ns;
+    });
+    char line[256];
+    snprintf(line, sizeof line, "%12s %14s %14s %7s  %s\n", "calls", "inclusive ms", "exclusive ms", "excl %", "procedure");
+    os << line;
+    for (const ProfileEntry *e : sorted) {
+        snprintf(line, sizeof line, "%12llu %14.3f %14.3f %6.1f%%  ", e->calls, e->inclusive_ns / 1e6,
+                 e->exclusive_ns / 1e6, total_ns > 0 ? 100 * e->exclusive_ns / total_ns : 0.0);
+        os << line << e->name << '\n';
+    }
+    os.flush();
+}
@@ -0,0 +1,54 @@
+#ifndef PROFILE
+#define PROFILE
+
+/**
+ * @file profile.hpp
+ * @brief Per-procedure call counts and time for --profile
+ *
+ * With profiling on, the parser builds ProfiledApply nodes instead of Apply,
+ * and each run of a procedure body is timed by a ProfileScope. A procedure is
+ * known by its body, under the name it was defined with or the line its
+ * lambda starts on. Inclusive time counts an activation and everything it
+ * called, once even when the procedure recurses; exclusive time leaves out
+ * the procedures it called. A call made in tail position ends its caller's
+ * activation, as it does on the stack. When profiling is off nothing here
+ * runs: plain Apply nodes have no profiling code at all.
+ */
+
+#include "Def.hpp"
+#include <chrono>
+#include <ostream>
+
+void enableProfiling();
+bool profiling();
+
+/**
+ * @brief Names the procedures whose body is the given expression
+ */
+void profileProcedure(const ExprBase *body, const std::string &name);
+
+struct ProfileEntry;
+
+/**
+ * @brief Times one activation of a procedure body for as long as it exists
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(const ExprBase *body);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    ProfileEntry *entry;
+    std::chrono::steady_clock::time_point start;
+    double callees_ns;  ///< Inclusive time of the activations started inside this one
+    ProfileScope *outer;
+};
+
+/**
+ * @brief Writes the procedures sorted by exclusive time
+ */
+void printProfile(std::ostream &);
+
+#endif
@@ -0,0 +1,319 @@
+/**
+ * @file resolve.cpp
+ * @brief Implementation of the lexical addressing pass
+ *
+ * Each resolve method visits its subexpressions with the Scope they will be
+ * evaluated in. The push order here must match the order in which
+ * evaluation.cpp extends the runtime environment.
+ */
+
+#include "resolve.hpp"
+#include "RE.hpp"
+#include "profile.hpp"
+
+// ============================================================================
+// Scope
+// ============================================================================
+
+Scope::Scope() {
+    levels.push_back(Level());
+    levels.back().captures = nullptr;
+}
+
+void Scope::push(const std::vector<Sym> &names, std::vector<bool> *boxed, bool rec) {
+    Bindings b;
+    b.names = names;
+    b.captured.assign(names.size(), false);
+    b.assigned.assign(names.size(), false);
+    b.boxed = boxed;
+    b.rec = rec;
+    levels.back().frames.push_back(b);
+}
+
+void Scope::pop() {
+    Bindings &b = levels.back().frames.back();
+    if (b.boxed != nullptr) {
+        b.boxed->assign(b.names.size(), false);
+        for (size_t i = 0; i < b.names.size(); ++i) {
+            (*b.boxed)[i] = b.captured[i] && (b.assigned[i] || b.rec);
+        }
+    }
+    levels.back().frames.pop_back();
+}
+
+void Scope::enterLambda(std::vector<std::pair<int, int>> *captures) {
+    levels.push_back(Level());
+    levels.back().captures = captures;
+    push(std::vector<Sym>(), nullptr, false); // the closure frame
+}
+
+void Scope::leaveLambda() {
+    levels.pop_back();
+}
+
+bool Scope::find(int level, Sym name, int &depth, int &index, Origin &origin) {
+    Level &lv = levels[level];
+    depth = 0;
+    for (int f = (int)lv.frames.size() - 1; f >= 0; --f, ++depth) {
+        const Bindings &b = lv.frames[f];
+        // a later duplicate shadows an earlier one, as with repeated parameters
+        for (index = (int)b.names.size() - 1; index >= 0; --index) {
+            if (b.names[index] == name) {
+                bool closure_frame = f == 0 && lv.captures != nullptr;
+                origin = closure_frame ? b.origin[index] : Origin{level, f, index};
+                return true;
+            }
+        }
+    }
+    if (lv.captures == nullptr) {
+        return false;
+    }
+
+    // bound outside this lambda: copy it into the closure frame
+    int outer_depth, outer_index;
+    if (!find(level - 1, name, outer_depth, outer_index, origin)) {
+        return false;
+    }
+    levels[origin.level].frames[origin.frame].captured[origin.slot] = true;
+    Bindings &closure = lv.frames[0];
+    closure.names.push_back(name);
+    closure.origin.push_back(origin);
+    lv.captures->push_back(std::make_pair(outer_depth, outer_index));
+    depth = (int)lv.frames.size() - 1;
+    index = (int)closure.names.size() - 1;
+    return true;
+}
+
+bool Scope::lookup(Sym name, int &depth, int &index, bool &boxed, bool assign) {
+    Origin origin;
+    if (!find((int)levels.size() - 1, name, depth, index, origin)) {
+        depth = -1;
+        index = 0;
+        boxed = false;
+        return false;
+    }
+    Bindings &b = levels[origin.level].frames[origin.frame];
+    if (assign) {
+        b.assigned[origin.slot] = true;
+    }
+    // empty until the first pass has popped the binding
+    boxed = b.boxed != nullptr && origin.slot < (int)b.boxed->size() && (*b.boxed)[origin.slot];
+    return true;
+}
+
+bool Scope::innermost(Sym name) const {
+    const Level &lv = levels.back();
+    if (lv.frames.empty()) {
+        return false;
+    }
+    for (const auto &n : lv.frames.back().names) {
+        if (n == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scope::topLevel() const {
+    return levels.size() == 1 && levels[0].frames.empty();
+}
+
+void resolve(Expr &expr) {
+    for (int pass = 0; pass < 2; ++pass) {
+        Scope scope;
+        expr->resolve(scope);
+    }
+}
+
+// ============================================================================
+// Expressions without bindings of their own
+// ============================================================================
+
+void ExprBase::resolve(Scope &scope) {} // literals, quote, void, exit
+
+void Unary::resolve(Scope &scope) {
+    rand->resolve(scope);
+}
+
+void Binary::resolve(Scope &scope) {
+    rand1->resolve(scope);
+    rand2->resolve(scope);
+}
+
+void Variadic::resolve(Scope &scope) {
+    for (auto &r : rands) {
+        r->resolve(scope);
+    }
+}
+
+void AndVar::resolve(Scope &scope) {
+    for (auto &r : rands) {
+        r->resolve(scope);
+    }
+}
+
+void OrVar::resolve(Scope &scope) {
+    for (auto &r : rands) {
+        r->resolve(scope);
+    }
+}
+
+void Begin::resolve(Scope &scope) {
+    for (auto &expr : es) {
+        expr->resolve(scope);
+    }
+}
+
+void If::resolve(Scope &scope) {
+    cond->resolve(scope);
+    conseq->resolve(scope);
+    alter->resolve(scope);
+}
+
+void Cond::resolve(Scope &scope) {
+    for (auto &clause : clauses) {
+        for (size_t j = 0; j < clause.size(); ++j) {
+            // the parser marks an else clause with Var("else"), which is never looked up
+            if (j == 0) {
+                auto marker = dynamic_cast<Var*>(clause[0].get());
+                if (marker != nullptr && marker->x.str() == "else") {
+                    continue;
+                }
+            }
+            clause[j]->resolve(scope);
+        }
+    }
+}
+
+void Apply::resolve(Scope &scope) {
+    rator->resolve(scope);
+    for (auto &r : rand) {
+        r->resolve(scope);
+    }
+}
+
+// ============================================================================
+// Variable references and assignments
+// ============================================================================
+
+void Var::resolve(Scope &scope) {
+    scope.lookup(x, depth, index, boxed);
+    cell = nullptr;
+}
+
+void Set::resolve(Scope &scope) {
+    e->resolve(scope);
+    scope.lookup(var, depth, index, boxed, true);
+    cell = nullptr;
+}
+
+void Define::resolve(Scope &scope) {
+    e->resolve(scope);
+    if (scope.topLevel()) {
+        depth = -1;
+        return;
+    }
+    // the parser reserves a slot for every define at the start of a body
+    if (!scope.innermost(var)) {
+        throw RuntimeError("define is only allowed at the top level or at the start of a body");
+    }
+    scope.lookup(var, depth, index, boxed);
+}
+
+// ============================================================================
+// Binding constructs
+// ============================================================================
+
+void Lambda::resolve(Scope &scope) {
+    captures.clear();
+    scope.enterLambda(&captures);
+    scope.push(x, &boxed, false);
+    e->resolve(scope);
+    scope.pop();
+    scope.leaveLambda();
+    e->markTail();
+    if (profiling()) {
+        if (name != Sym()) {
+            profileProcedure(e.get(), name.str());
+        } else {
+            profileProcedure(e.get(), line > 0 ? "lambda at line " + std::to_string(line) : "lambda");
+        }
+    }
+}
+
+void Let::resolve(Scope &scope) {
+    std::vector<Sym> names;
+    for (auto &b : bind) {
+        b.second->resolve(scope);
+        names.push_back(b.first);
+    }
+    scope.push(names, &boxed, false);
+    body->resolve(scope);
+    scope.pop();
+}
+
+void Letrec::resolve(Scope &scope) {
+    std::vector<Sym> names;
+    for (auto &b : bind) {
+        names.push_back(b.first);
+    }
+    scope.push(names, &boxed, true);
+    for (auto &b : bind) {
+        if (b.second.get() != nullptr) {
+            b.second->resolve(scope);
+        }
+    }
+    body->resolve(scope);
+    scope.pop();
+}
+
+// ============================================================================
+// Tail positions
+// ============================================================================
+
+// Only reached from Lambda::resolve, so top-level calls never become tail calls
+void ExprBase::markTail() {}
+
+void Begin::markTail() {
+    if (!es.empty()) {
+        es.back()->markTail();
+    }
+}
+
+void If::markTail() {
+    conseq->markTail();
+    alter->markTail();
+}
+
+void Cond::markTail() {
+    // a clause with only a test returns the test's value, which is not a tail position
+    for (auto &clause : clauses) {
+        if (clause.size() > 1) {
+            clause.back()->markTail();
+        }
+    }
+}
+
+void AndVar::markTail() {
+    if (!rands.empty()) {
+        rands.back()->markTail();
+    }
+}
+
+void OrVar::markTail() {
+    if (!rands.empty()) {
+        rands.back()->markTail();
+    }
+}
+
+void Let::markTail() {
+    body->markTail();
+}
+
+void Letrec::markTail() {
+    body->markTail();
+}
+
+void Apply::markTail() {
+    tail = true;
+}
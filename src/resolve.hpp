@@ -0,0 +1,82 @@
+#ifndef RESOLVE
+#define RESOLVE
+
+/**
+ * @file resolve.hpp
+ * @brief Lexical addressing pass over parsed expression trees
+ *
+ * After List::parse has produced an expression, the resolver walks it with a
+ * compile-time picture of the environment the expression will run in. Every
+ * Var, Set and internal Define is annotated with the address of its binding
+ * (frames to skip, slot within the frame), so evaluation can reach the value
+ * without comparing names. Names that are not bound locally are globals; those are
+ * reached through a binding cell that Var caches after the first lookup.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+ * @brief Compile-time mirror of the local environment
+ *
+ * Closures are flat: a procedure keeps only the values of the locals its body
+ * uses from outside, in a closure frame built when the lambda is evaluated,
+ * rather than the whole enclosing chain. The scope is therefore split into
+ * levels, one per enclosing lambda plus the top level. Within a level each
+ * Bindings is one group of names introduced together (the parameters of a
+ * lambda, the bindings of a let or letrec), innermost last, and corresponds
+ * to one runtime Frame. frames[0] of a lambda level is its closure frame,
+ * which grows as lookups from the body reach outside the lambda.
+ *
+ * A captured copy cannot follow later assignments, so a binding that is
+ * captured and also assigned (by set!, or by letrec initialization after the
+ * closure was made) lives in a Box and every copy shares the box.
+ */
+struct Scope {
+    struct Origin {
+        int level;
+        int frame;
+        int slot;
+    };
+
+    struct Bindings {
+        std::vector<Sym> names;            ///< In slot order
+        std::vector<bool> captured;        ///< Referenced from a nested lambda
+        std::vector<bool> assigned;        ///< Target of set!
+        std::vector<bool> *boxed;          ///< The binding node's box flags, written by pop
+        bool rec;                          ///< Bound before its value exists, as in letrec
+        std::vector<Origin> origin;        ///< Closure frame only: the binding each copy is of
+    };
+
+    struct Level {
+        std::vector<Bindings> frames;
+        std::vector<std::pair<int, int>> *captures; ///< The lambda's capture addresses, null at top level
+    };
+
+    std::vector<Level> levels;
+
+    Scope();
+    void push(const std::vector<Sym> &, std::vector<bool> *, bool);
+    void pop();
+    void enterLambda(std::vector<std::pair<int, int>> *);
+    void leaveLambda();
+    bool lookup(Sym, int &, int &, bool &, bool = false);
+    bool innermost(Sym) const;
+    bool topLevel() const;
+
+private:
+    bool find(int, Sym, int &, int &, Origin &);
+};
+
+/**
+ * @brief Resolves a top-level expression, which runs with no local bindings
+ *
+ * Runs the pass twice: which bindings need a Box is only known once their
+ * whole scope has been seen, and the second pass tells every reference.
+ */
+void resolve(Expr &);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file source.cpp
+ * @brief Loading program text for the reader
+ */
+
+#include "source.hpp"
+#include "RE.hpp"
+#include <iostream>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Source::Source(const std::string &path)
+    : mapped(nullptr), mapped_size(0), pos(nullptr), end(nullptr), counted(nullptr), lines(0) {
+    if (path == "-") {
+        copy.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        pos = copy.data();
+        end = pos + copy.size();
+        counted = pos;
+        return;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw RuntimeError("Cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw RuntimeError("Cannot read " + path);
+    }
+    if (st.st_size > 0) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            mapped = p;
+            mapped_size = st.st_size;
+            madvise(p, mapped_size, MADV_SEQUENTIAL);
+            pos = static_cast<const char *>(p);
+            end = pos + mapped_size;
+        }
+    }
+    if (mapped == nullptr) { // empty, or not mappable like a pipe
+        char buf[1 << 16];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof buf)) > 0) {
+            copy.append(buf, n);
+        }
+        pos = copy.data();
+        end = pos + copy.size();
+    }
+    counted = pos;
+    close(fd);
+}
+
+// The reader only moves forward, so each byte is counted once over a whole run
+int Source::line() {
+    for (; counted < pos; ++counted) {
+        if (*counted == '\n') ++lines;
+    }
+    return lines + 1;
+}
+
+Source::~Source() {
+    if (mapped != nullptr) {
+        munmap(mapped, mapped_size);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SOURCE
+#define SOURCE
+
+/**
+ * @file source.hpp
+ * @brief Program text held in memory for the reader
+ *
+ * A script file is memory-mapped and standard input is read in one go, so the
+ * reader walks a pointer over contiguous bytes instead of calling peek() and
+ * get() on a stream for every character. peek() and get() mirror the
+ * std::istream calls the reader makes, including returning EOF at the end.
+ */
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+
+class Source {
+public:
+    /**
+     * @brief Loads a file, or standard input when path is "-"
+     * @throws RuntimeError if the file cannot be opened or read
+     */
+    explicit Source(const std::string &path);
+    ~Source();
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+
+    int peek() const { return pos < end ? (unsigned char)*pos : EOF; }
+    int get() { return pos < end ? (unsigned char)*pos++ : EOF; }
+    const char *position() const { return pos; }    ///< Next byte get() would return
+    int line();         ///< 1-based line of position()
+
+private:
+    void *mapped;       ///< The mapping of a file, null when the text was read into copy
+    size_t mapped_size;
+    std::string copy;
+    const char *pos;
+    const char *end;
+    const char *counted;    ///< Newlines before this point are in lines
+    int lines;
+};
+
+#endif
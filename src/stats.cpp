@@ -0,0 +1,74 @@
+/**
+ * @file stats.cpp
+ * @brief Reporting the runtime counters
+ */
+
+#include "stats.hpp"
+#include "value.hpp"
+
+RuntimeStats runtime_stats;
+
+static const char *typeName(int type) {
+    static const char *names[] = {
+        "integer", "bignum", "rational", "big-rational", "boolean", "symbol", "null", "string",
+        "pair", "procedure", "primitive", "box", "void", "terminate", "void-define",
+    };
+    return names[type];
+}
+
+static Value count(size_t n) {
+    return IntegerV(BigInt((long long)n));
+}
+
+static Value entry(const char *name, const Value &v) {
+    return PairV(SymbolV(intern(name)), v);
+}
+
+Value runtimeStatsList() {
+    const RuntimeStats &s = runtime_stats;
+    // built back to front; every Value in reach stays on the stack the collector scans
+    Value by_type = NullV();
+    for (int t = V_VOID_DEFINE; t >= 0; --t) {
+        if (s.allocated[t] > 0) {
+            by_type = PairV(entry(typeName(t), count(s.allocated[t])), by_type);
+        }
+    }
+    std::pair<const char *, size_t> counters[] = {
+        {"frames", s.frames},
+        {"local-lookups", s.local_lookups},
+        {"frame-hops", s.frame_hops},
+        {"scope-extends", s.scope_extends},
+        {"scope-finds", s.scope_finds},
+        {"first-class-primitive-calls", s.first_class_primitive_calls},
+        {"procedure-calls", s.procedure_calls},
+        {"tail-calls", s.tail_calls},
+        {"errors", s.errors},
+    };
+    Value list = NullV();
+    for (int i = sizeof counters / sizeof counters[0] - 1; i >= 0; --i) {
+        list = PairV(entry(counters[i].first, count(counters[i].second)), list);
+    }
+    return PairV(entry("allocations", by_type), list);
+}
+
+void printRuntimeStats(std::ostream &os) {
+    const RuntimeStats &s = runtime_stats;
+    os << "stats: allocated";
+    bool any = false;
+    for (int t = 0; t <= V_VOID_DEFINE; ++t) {
+        if (s.allocated[t] > 0) {
+            os << (any ? ", " : " ") << s.allocated[t] << ' ' << typeName(t);
+            any = true;
+        }
+    }
+    if (!any) {
+        os << " nothing";
+    }
+    os << "; " << s.frames << " frames, "
+       << s.local_lookups << " local lookups over " << s.frame_hops << " frame hops, "
+       << s.scope_finds << " scope finds, "
+       << s.scope_extends << " scope extends, "
+       << s.first_class_primitive_calls << " first-class primitive calls, "
+       << s.procedure_calls << " procedure calls (" << s.tail_calls << " tail), "
+       << s.errors << " errors" << std::endl;
+}
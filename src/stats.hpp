@@ -0,0 +1,48 @@
+#ifndef STATS
+#define STATS
+
+/**
+ * @file stats.hpp
+ * @brief Counters of interpreter work, for --stats and (runtime-stats)
+ *
+ * The counters are always kept: each is a plain increment at the point the
+ * work happens, next to an allocation, a frame walk or a call that costs far
+ * more. They count from startup and are never reset.
+ *
+ * Calls are counted where Apply and the VM's OP_CALL dispatch on the value
+ * being called. A primitive named directly, as in (car x) or (+ a b), is
+ * parsed into its own node and never dispatches. Only primitives called as
+ * values, like f in (f a b) with f bound to +, count as first-class
+ * primitive calls.
+ */
+
+#include "Def.hpp"
+#include <cstddef>
+#include <ostream>
+
+struct RuntimeStats {
+    size_t allocated[V_VOID_DEFINE + 1]; ///< Heap values made, by type
+    size_t frames;              ///< Activation frames made for calls, let and letrec
+    size_t local_lookups;       ///< Lexical addresses walked by locate
+    size_t frame_hops;          ///< Parent links followed by those walks
+    size_t scope_extends;       ///< Parser scope bindings made by extend
+    size_t scope_finds;         ///< Parser scope searches made by find
+    size_t first_class_primitive_calls; ///< Calls that dispatched to a primitive value, as above
+    size_t procedure_calls;     ///< Calls that dispatched to a procedure, tail calls included
+    size_t tail_calls;
+    size_t errors;              ///< RuntimeErrors constructed, caught or not
+};
+
+extern RuntimeStats runtime_stats;
+
+/**
+ * @brief The counters as an association list of (name . count)
+ *
+ * Allocations are one entry whose value is itself a list of (type . count)
+ * for the types allocated at least once.
+ */
+Value runtimeStatsList();
+
+void printRuntimeStats(std::ostream &);
+
+#endif
@@ -1,17 +1,32 @@
 #include "syntax.hpp"
+#include "arena.hpp"
+#include "source.hpp"
+#include <climits>
 #include <cstring>
 #include <vector>
 
+static void destroySyntax(void *p) {
+    static_cast<SyntaxBase *>(p)->~SyntaxBase();
+}
+
+void *SyntaxBase::operator new(size_t size) { return currentArena().allocate(size, destroySyntax); }
+void SyntaxBase::operator delete(void *p) { currentArena().forget(p); }
+
 Syntax::Syntax(SyntaxBase *stx) : ptr(stx) {}
-SyntaxBase* Syntax::operator->() const { return ptr.get(); }
+SyntaxBase* Syntax::operator->() const { return ptr; }
 SyntaxBase& Syntax::operator*() { return *ptr; }
-SyntaxBase* Syntax::get() const { return ptr.get(); }
+SyntaxBase* Syntax::get() const { return ptr; }
 
 Number::Number(int n) : n(n) {}
 void Number::show(std::ostream &os) {
   os << "the-number-" << n;
 }
 
+BigNumber::BigNumber(const BigInt &n) : n(n) {}
+void BigNumber::show(std::ostream &os) {
+  os << "the-number-" << n.toString();
+}
+
 RationalSyntax::RationalSyntax(int num, int den) : numerator(num), denominator(den) {}
 void RationalSyntax::show(std::ostream &os) {
   os << numerator << "/" << denominator;
@@ -25,9 +40,9 @@ void FalseSyntax::show(std::ostream &os) {
   os << "#f";
 }
 
-SymbolSyntax::SymbolSyntax(const std::string &s1) : s(s1) {}
+SymbolSyntax::SymbolSyntax(const std::string &s1) : s(intern(s1)) {}
 void SymbolSyntax::show(std::ostream &os) {
-    os << s;
+    os << s.str();
 }
 
 StringSyntax::StringSyntax(const std::string &s1) : s(s1) {}
@@ -35,7 +50,7 @@ void StringSyntax::show(std::ostream &os) {
     os << "\"" << s << "\"";
 }
 
-List::List() {}
+List::List() : line(0) {}
 void List::show(std::ostream &os) {
     os << '(';
     for (auto stx : stxs) {
@@ -45,7 +60,10 @@ void List::show(std::ostream &os) {
     os << ')';
 }
 
-std::istream &readSpace(std::istream &is) {
+// The reader is written once over the operations std::istream and Source share
+
+template <class Input>
+static Input &readSpace(Input &is) {
   while (true) {
     // 跳过空白字符
     while (isspace(is.peek()))
@@ -65,12 +83,17 @@ std::istream &readSpace(std::istream &is) {
   return is;
 }
 
-Syntax readList(std::istream &is);
+template <class Input>
+static Syntax readList(Input &is, int line);
 
-// Helper function to try parsing as integer or rational
+// Only a whole-text Source knows where it is; the REPL's stream does not
+static int lineOf(std::istream &) { return 0; }
+static int lineOf(Source &src) { return src.line(); }
+
+// Helper function to try parsing as integer or rational; fails if the value does not fit an int
 bool tryParseNumber(const std::string &s, int &result) {
   bool neg = false;
-  int n = 0;
+  long long n = 0;
   int i = 0;
   
   // Single '+' or '-' are not numbers
@@ -89,12 +112,28 @@ bool tryParseNumber(const std::string &s, int &result) {
   for (; i < s.size(); i++) {
     if ('0' <= s[i] && s[i] <= '9') {
       n = n * 10 + s[i] - '0';
+      if (n > (long long)INT_MAX + 1)
+        return false;  // Too large, read as a bignum
     } else {
       return false;  // Not a valid number
     }
   }
   
-  result = neg ? -n : n;
+  if (!neg && n > INT_MAX)
+    return false;
+  result = (int)(neg ? -n : n);
+  return true;
+}
+
+// Helper function to try parsing as an integer of any size
+bool isIntegerToken(const std::string &s) {
+  size_t i = (s[0] == '+' || s[0] == '-') ? 1 : 0;
+  if (i == s.size())
+    return false;
+  for (; i < s.size(); i++) {
+    if (s[i] < '0' || s[i] > '9')
+      return false;
+  }
   return true;
 }
 
@@ -130,11 +169,41 @@ Syntax createIdentifierSyntax(const std::string &s) {
   return Syntax(new SymbolSyntax(s));
 }
 
+// Characters up to the next delimiter
+static std::string readToken(std::istream &is) {
+  std::string s;
+  do {
+    int c = is.peek();
+    if (c == '(' || c == ')' ||
+        c == '[' || c == ']' || 
+        c == ';' ||  // 添加分号作为分隔符
+        isspace(c) ||
+        c == EOF)
+      break;
+    is.get();
+    s.push_back(c);
+  } while (true);
+  return s;
+}
+
+// Finds the end of the token first so the string is built in one step
+static std::string readToken(Source &src) {
+  const char *begin = src.position();
+  for (int c = src.peek(); c != EOF; c = src.peek()) {
+    if (c == '(' || c == ')' || c == '[' || c == ']' || c == ';' || isspace(c))
+      break;
+    src.get();
+  }
+  return std::string(begin, src.position());
+}
+
 // no leading space
-Syntax readItem(std::istream &is) {
+template <class Input>
+static Syntax readItem(Input &is) {
   if (is.peek() == '(' || is.peek() == '[') {
+    int line = lineOf(is);
     is.get();
-    return readList(is);
+    return readList(is, line);
   }
   if (is.peek() == '\'')
   {
@@ -177,18 +246,7 @@ Syntax readItem(std::istream &is) {
   }
   
   // Read token
-  std::string s;
-  do {
-    int c = is.peek();
-    if (c == '(' || c == ')' ||
-        c == '[' || c == ']' || 
-        c == ';' ||  // 添加分号作为分隔符
-        isspace(c) ||
-        c == EOF)
-      break;
-    is.get();
-    s.push_back(c);
-  } while (true);
+  std::string s = readToken(is);
   
   // Try parsing as rational first
   int numerator, denominator;
@@ -201,14 +259,19 @@ Syntax readItem(std::istream &is) {
   if (tryParseNumber(s, number_value)) {
     return Syntax(new Number(number_value));
   }
+  if (isIntegerToken(s)) {
+    return Syntax(new BigNumber(BigInt(s)));
+  }
   
   // Not a number, treat as identifier/symbol
   return createIdentifierSyntax(s);
 }
 
-Syntax readList(std::istream &is) {
+template <class Input>
+static Syntax readList(Input &is, int line) {
     List *stx = new List();
-    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ')')
+    stx->line = line;
+    while (readSpace(is).peek() != ')' && is.peek() != EOF)
         stx->stxs.push_back(readItem(is));
     is.get(); // ')'
     return Syntax(stx);
@@ -218,6 +281,12 @@ Syntax readSyntax(std::istream &is) {
   return readItem(readSpace(is));
 }
 
+Syntax readSyntax(Source &src) {
+  if (readSpace(src).peek() == EOF)
+    return Syntax(nullptr);
+  return readItem(src);
+}
+
 std::istream &operator>>(std::istream &is, Syntax &stx) {
   stx = readSyntax(is);
   return is;
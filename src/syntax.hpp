@@ -5,15 +5,19 @@
 #include <memory>
 #include <vector>
 #include "Def.hpp"
+#include "bigint.hpp"
 
+// Allocated in the current arena (arena.hpp) and freed with it
 struct SyntaxBase {
     virtual Expr parse(Assoc &) = 0;
     virtual void show(std::ostream &) = 0;
     virtual ~SyntaxBase() = default;
+    static void *operator new(size_t);
+    static void operator delete(void *);
 };
 
 struct Syntax {
-    std::shared_ptr<SyntaxBase> ptr;
+    SyntaxBase *ptr;
     Syntax(SyntaxBase *);
     SyntaxBase* operator->() const;
     SyntaxBase& operator*();
@@ -28,6 +32,14 @@ struct Number : SyntaxBase {
     virtual void show(std::ostream &) override;
 };
 
+// An integer literal that does not fit in an int
+struct BigNumber : SyntaxBase {
+    BigInt n;
+    BigNumber(const BigInt &);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
 struct RationalSyntax : SyntaxBase {
     int numerator;
     int denominator;
@@ -49,7 +61,7 @@ struct FalseSyntax : SyntaxBase {
 };
 
 struct SymbolSyntax : SyntaxBase {
-    std::string s;
+    Sym s;
     SymbolSyntax(const std::string &);
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
@@ -64,6 +76,7 @@ struct StringSyntax : SyntaxBase {
 
 struct List : SyntaxBase {
     std::vector<Syntax> stxs;
+    int line;           ///< Where the list opens; 0 when the input does not count lines
     List();
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
@@ -71,5 +84,12 @@ struct List : SyntaxBase {
 
 Syntax readSyntax(std::istream &);
 
+class Source;
+
+/**
+ * @brief Reads the next top-level form, or returns a null Syntax at the end of the text
+ */
+Syntax readSyntax(Source &);
+
 std::istream &operator>>(std::istream &, Syntax);
 #endif
\ No newline at end of file
@@ -7,12 +7,21 @@
  */
 
 #include "value.hpp"
+#include "RE.hpp"
+#include "stats.hpp"
+#include <climits>
+#include <new>
+#include <unordered_map>
 
 // ============================================================================
 // Base ValueBase Implementation
 // ============================================================================
 
-ValueBase::ValueBase(ValueType vt) : v_type(vt) {}
+ValueBase::ValueBase(ValueType vt) : v_type(vt), marked(false) {
+    ++runtime_stats.allocated[vt];
+}
+
+void ValueBase::trace() {} // no references to other objects
 
 void ValueBase::showCdr(std::ostream &os) {
     os << " . ";
@@ -21,32 +30,45 @@ void ValueBase::showCdr(std::ostream &os) {
 }
 
 // ============================================================================
-// Value Smart Pointer Implementation
+// Value Implementation
 // ============================================================================
 
-Value::Value(ValueBase *ptr) : ptr(ptr) {}
-
-ValueBase* Value::operator->() const { 
-    return ptr.get(); 
-}
-
-ValueBase& Value::operator*() { 
-    return *ptr; 
-}
-
-ValueBase* Value::get() const { 
-    return ptr.get(); 
+void Value::show(std::ostream &os) const {
+    switch (bits & TAG_MASK) {
+        case TAG_FIXNUM:
+            os << fixnum();
+            return;
+        case TAG_SPECIAL:
+            switch (bits >> 2) {
+                case S_FALSE: os << "#f"; return;
+                case S_TRUE: os << "#t"; return;
+                case S_NULL: os << "()"; return;
+                case S_TERMINATE: os << "()"; return;
+                default: os << "#<void>"; return;
+            }
+        default:
+            ptr()->show(os);
+    }
 }
 
-void Value::show(std::ostream &os) {
-    ptr->show(os);
+// Prints the rest of a list whose previous cdr was this value
+void Value::showCdr(std::ostream &os) const {
+    if (boxed()) {
+        ptr()->showCdr(os);
+    } else if (type() == V_NULL) {
+        os << ')';
+    } else {
+        os << " . ";
+        show(os);
+        os << ')';
+    }
 }
 
 // ============================================================================
 // Environment (Association List) Implementation
 // ============================================================================
 
-AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
+AssocList::AssocList(Sym x, const Value &v, Assoc &next)
     : x(x), v(v), next(next) {}
 
 Assoc::Assoc(AssocList *x) : ptr(x) {}
@@ -67,11 +89,12 @@ Assoc empty() {
     return Assoc(nullptr);
 }
 
-Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
+Assoc extend(Sym x, const Value &v, Assoc &lst) {
+    ++runtime_stats.scope_extends;
     return Assoc(new AssocList(x, v, lst));
 }
 
-void modify(const std::string &x, const Value &v, Assoc &lst) {
+void modify(Sym x, const Value &v, Assoc &lst) {
     for (auto i = lst; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
             i->v = v;
@@ -80,7 +103,8 @@ void modify(const std::string &x, const Value &v, Assoc &lst) {
     }
 }
 
-Value find(const std::string &x, Assoc &l) {
+Value find(Sym x, Assoc &l) {
+    ++runtime_stats.scope_finds;
     for (auto i = l; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
             return i->v;
@@ -90,61 +114,124 @@ Value find(const std::string &x, Assoc &l) {
 }
 
 // ============================================================================
-// Simple Value Types Implementation
+// Global Environment Implementation
 // ============================================================================
 
-// Void
-Void::Void() : ValueBase(V_VOID) {}
+// unordered_map never moves its elements, which is what keeps cells stable
+static std::unordered_map<Sym, Value> &globals() {
+    static std::unordered_map<Sym, Value> table;
+    return table;
+}
 
-void Void::show(std::ostream &os) {
-    os << "#<void>";
+static struct GlobalsRoot : GcRoot {
+    virtual void trace() override {
+        for (auto &binding : globals()) {
+            gcMark(binding.second);
+        }
+    }
+} globals_root;
+
+Value *findGlobal(Sym x) {
+    auto it = globals().find(x);
+    return it == globals().end() ? nullptr : &it->second;
+}
+
+Value *defineGlobal(Sym x, const Value &v) {
+    auto it = globals().find(x);
+    if (it != globals().end()) {
+        it->second = v;
+        return &it->second;
+    }
+    return &globals().insert(std::make_pair(x, v)).first->second;
 }
 
+// ============================================================================
+// Activation Frame Implementation
+// ============================================================================
+
+Frame::Frame(int size, const Env &parent) : marked(false), size(size), parent(parent) {}
+
+Env makeFrame(int size, const Env &parent) {
+    ++runtime_stats.frames;
+    void *mem = gcAllocate(sizeof(Frame) + size * sizeof(Value), GC_FRAME);
+    Frame *f = new (mem) Frame(size, parent);
+    Value *slots = f->slots();
+    for (int i = 0; i < size; ++i) {
+        new (&slots[i]) Value(nullptr);
+    }
+    return Env(f);
+}
+
+// Walks a resolved lexical address; the resolver guarantees the chain is long enough
+Value &locate(int depth, int index, Env &env) {
+    Frame *f = env.get();
+    ++runtime_stats.local_lookups;
+    runtime_stats.frame_hops += depth;
+    while (depth-- > 0) {
+        f = f->parent.get();
+    }
+    return f->slots()[index];
+}
+
+// ============================================================================
+// Simple Value Types Implementation
+// ============================================================================
+
+// Void
 Value VoidV() {
-    return Value(new Void());
+    return Value::special(Value::S_VOID);
+}
+
+Value VoidD() {
+    return Value::special(Value::S_VOID_DEFINE);
 }
 
 // Integer
-Integer::Integer(int n) : ValueBase(V_INT), n(n) {}
+Value IntegerV(int n) {
+    // shift the unsigned pattern so negative numbers stay well defined
+    return Value(((uintptr_t)(intptr_t)n << 2) | Value::TAG_FIXNUM);
+}
+
+// Bignum
+BigNum::BigNum(const BigInt &n) : ValueBase(V_BIGINT), n(n) {}
 
-void Integer::show(std::ostream &os) {
-    os << n;
+void BigNum::show(std::ostream &os) {
+    os << n.toString();
 }
 
-Value IntegerV(int n) {
-    return Value(new Integer(n));
+Value IntegerV(const BigInt &n) {
+    if (n.fitsInt()) {
+        return IntegerV(n.toInt());
+    }
+    return Value(new BigNum(n));
 }
 
 // Rational
-// Helper function to calculate greatest common divisor
-static int gcd(int a, int b) {
-    if (a < 0) a = -a;
-    if (b < 0) b = -b;
-    while (b != 0) {
-        int temp = b;
-        b = a % b;
-        a = temp;
-    }
-    return a;
+// Stein's algorithm: shifts and subtractions only, no division
+unsigned long long binaryGcd(unsigned long long u, unsigned long long v) {
+    if (u == 0) return v;
+    if (v == 0) return u;
+    int shift = __builtin_ctzll(u | v);
+    u >>= __builtin_ctzll(u);
+    do {
+        v >>= __builtin_ctzll(v);
+        if (u > v) {
+            unsigned long long t = u;
+            u = v;
+            v = t;
+        }
+        v -= u;
+    } while (v != 0);
+    return u << shift;
 }
 
-Rational::Rational(int num, int den) : ValueBase(V_RATIONAL) {
-    if (den == 0) {
-        throw std::runtime_error("Division by zero");
-    }
-    
-    // Simplify the fraction
-    int g = gcd(num, den);
-    numerator = num / g;
-    denominator = den / g;
-    
-    // Ensure denominator is positive
-    if (denominator < 0) {
-        numerator = -numerator;
-        denominator = -denominator;
-    }
+static unsigned long long magnitude(long long n) {
+    return n < 0 ? 0ULL - (unsigned long long)n : (unsigned long long)n;
 }
 
+Rational::Rational(long long num, long long den)
+    : ValueBase(V_RATIONAL), numerator(num), denominator(den) {}
+
 void Rational::show(std::ostream &os) {
     if (denominator == 1) {
         os << numerator;
@@ -153,29 +240,68 @@ void Rational::show(std::ostream &os) {
     }
 }
 
-Value RationalV(int num, int den) {
+BigRational::BigRational(const BigInt &num, const BigInt &den)
+    : ValueBase(V_BIGRATIONAL), numerator(num), denominator(den) {}
+
+void BigRational::show(std::ostream &os) {
+    os << numerator.toString();
+    if (compare(denominator, BigInt(1)) != 0) {
+        os << "/" << denominator.toString();
+    }
+}
+
+Value ReducedRationalV(long long num, long long den) {
     return Value(new Rational(num, den));
 }
 
-// Boolean
-Boolean::Boolean(bool b) : ValueBase(V_BOOL), b(b) {}
+Value RationalV(long long num, long long den) {
+    if (den == 0) {
+        throw RuntimeError("Division by zero");
+    }
+    if (num == LLONG_MIN || den == LLONG_MIN) {
+        return RationalV(BigInt(num), BigInt(den));
+    }
+    unsigned long long g = binaryGcd(magnitude(num), magnitude(den));
+    num /= (long long)g;
+    den /= (long long)g;
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+    return ReducedRationalV(num, den);
+}
 
-void Boolean::show(std::ostream &os) {
-    os << (b ? "#t" : "#f");
+Value RationalV(const BigInt &num, const BigInt &den) {
+    if (den.isZero()) {
+        throw RuntimeError("Division by zero");
+    }
+    BigInt g = BigInt::gcd(num, den);
+    BigInt n, d, r;
+    BigInt::divMod(num, g, n, r);
+    BigInt::divMod(den, g, d, r);
+    if (d.negative()) {
+        n = -n;
+        d = -d;
+    }
+    if (n.fitsLongLong() && d.fitsLongLong()) {
+        return ReducedRationalV(n.toLongLong(), d.toLongLong());
+    }
+    return Value(new BigRational(n, d));
 }
 
+// Boolean
 Value BooleanV(bool b) {
-    return Value(new Boolean(b));
+    return Value::special(b ? Value::S_TRUE : Value::S_FALSE);
 }
 
 // Symbol
-Symbol::Symbol(const std::string &s) : ValueBase(V_SYM), s(s) {}
+Symbol::Symbol(Sym s) : ValueBase(V_SYM), s(s) {}
 
 void Symbol::show(std::ostream &os) {
-    os << s;
+    os << s.str();
 }
 
-Value SymbolV(const std::string &s) {
+Value SymbolV(Sym s) {
     return Value(new Symbol(s));
 }
 
@@ -195,29 +321,18 @@ Value StringV(const std::string &s) {
 // ============================================================================
 
 // Null
-Null::Null() : ValueBase(V_NULL) {}
-
-void Null::show(std::ostream &os) {
-    os << "()";
-}
-
-void Null::showCdr(std::ostream &os) {
-    os << ')';
-}
-
 Value NullV() {
-    return Value(new Null());
+    return Value::special(Value::S_NULL);
 }
 
 // Terminate
-Terminate::Terminate() : ValueBase(V_TERMINATE) {}
-
-void Terminate::show(std::ostream &os) {
-    os << "()";
+Value TerminateV() {
+    return Value::special(Value::S_TERMINATE);
 }
 
-Value TerminateV() {
-    return Value(new Terminate());
+// Tail call
+Value TailCallV() {
+    return Value::special(Value::S_TAIL_CALL);
 }
 
 // ============================================================================
@@ -230,12 +345,17 @@ Pair::Pair(const Value &car, const Value &cdr)
 
 void Pair::show(std::ostream &os) {
     os << '(' << car;
-    cdr->showCdr(os);
+    cdr.showCdr(os);
 }
 
 void Pair::showCdr(std::ostream &os) {
     os << ' ' << car;
-    cdr->showCdr(os);
+    cdr.showCdr(os);
+}
+
+void Pair::trace() {
+    gcMark(car);
+    gcMark(cdr);
 }
 
 Value PairV(const Value &car, const Value &cdr) {
@@ -243,22 +363,52 @@ Value PairV(const Value &car, const Value &cdr) {
 }
 
 // Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
+Procedure::Procedure(const std::vector<Sym> &xs, const Expr &e, const Env &env)
     : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
 
+Procedure::Procedure(const std::shared_ptr<Chunk> &chunk, const Env &env)
+    : ValueBase(V_PROC), e(nullptr), env(env), chunk(chunk) {}
+
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
 }
 
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
+void Procedure::trace() {
+    gcMark(env.get());
+}
+
+Value ProcedureV(const std::vector<Sym> &xs, const Expr &e, const Env &env) {
     return Value(new Procedure(xs, e, env));
 }
 
+// Box
+Box::Box(const Value &v) : ValueBase(V_BOX), v(v) {}
+
+void Box::show(std::ostream &os) {
+    v.show(os);
+}
+
+void Box::trace() {
+    gcMark(v);
+}
+
+Value BoxV(const Value &v) {
+    return Value(new Box(v));
+}
+
+// Primitive
+Primitive::Primitive(Sym name, PrimitiveFn fn, int min_args, int max_args)
+    : ValueBase(V_PRIMITIVE), name(name), fn(fn), min_args(min_args), max_args(max_args) {}
+
+void Primitive::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
 // ============================================================================
 // Utility Functions Implementation
 // ============================================================================
 
-std::ostream &operator<<(std::ostream &os, Value &v) {
-    v->show(os);
+std::ostream &operator<<(std::ostream &os, const Value &v) {
+    v.show(os);
     return os;
 }
@@ -10,24 +10,33 @@
  */
 
 #include "Def.hpp"
-#include "expr.hpp"
+#include "gc.hpp"
+#include "bigint.hpp"
 #include <memory>
 #include <cstring>
 #include <vector>
+#include <cstdint>
 
 // ============================================================================
 // Base classes and smart pointer wrappers
 // ============================================================================
 
 /**
- * @brief Base class for all values in the Scheme interpreter
+ * @brief Base class for heap-allocated values in the Scheme interpreter
+ *
+ * Allocated and freed by the collector (gc.hpp); trace reports the Values and
+ * frames the object refers to.
  */
 struct ValueBase {
     ValueType v_type;
+    bool marked;        ///< Set while a collection finds the object reachable
     ValueBase(ValueType);
     virtual void show(std::ostream &) = 0;
     virtual void showCdr(std::ostream &);
+    virtual void trace();
     virtual ~ValueBase() = default;
+    static void *operator new(size_t size) { return gcAllocate(size, GC_VALUE); }
+    static void operator delete(void *p) { gcForget(p); }
     virtual void show(std::ostream & os, int flag) {
         os<<"";
     };
@@ -35,15 +44,70 @@ struct ValueBase {
 };
 
 /**
- * @brief Smart pointer wrapper for ValueBase objects
+ * @brief A Scheme value in one machine word
+ *
+ * The two low bits are a tag. Fixnums, booleans, the empty list, void and
+ * the terminate signal are immediates encoded in the word itself and never
+ * allocate. Every other value is a pointer to a ValueBase owned by the
+ * collector, so copying a Value copies the word and nothing else. The
+ * all-zero word, Value(nullptr), is the placeholder of a binding that has no
+ * value yet.
+ *
+ * operator-> and get() are only meaningful for heap values; get() returns
+ * nullptr for immediates, so dynamic_cast on it fails cleanly.
  */
-struct Value {
-    std::shared_ptr<ValueBase> ptr;
-    Value(ValueBase *);
-    void show(std::ostream &);
-    ValueBase* operator->() const;
-    ValueBase& operator*();
-    ValueBase* get() const;
+class Value {
+    uintptr_t bits;
+
+    enum : uintptr_t { TAG_MASK = 3, TAG_PTR = 0, TAG_FIXNUM = 1, TAG_SPECIAL = 2 };
+    enum Special : uintptr_t { S_FALSE, S_TRUE, S_NULL, S_VOID, S_VOID_DEFINE, S_TERMINATE, S_TAIL_CALL };
+
+    explicit Value(uintptr_t bits) : bits(bits) {}
+    static Value special(Special s) { return Value((s << 2) | TAG_SPECIAL); }
+    bool boxed() const { return (bits & TAG_MASK) == TAG_PTR && bits != 0; }
+    ValueBase *ptr() const { return reinterpret_cast<ValueBase *>(bits); }
+
+    friend Value IntegerV(int);
+    friend Value BooleanV(bool);
+    friend Value NullV();
+    friend Value VoidV();
+    friend Value VoidD();
+    friend Value TerminateV();
+    friend Value TailCallV();
+
+public:
+    Value(ValueBase *p) : bits(reinterpret_cast<uintptr_t>(p)) {}
+
+    ValueType type() const {
+        switch (bits & TAG_MASK) {
+            case TAG_FIXNUM: return V_INT;
+            case TAG_SPECIAL: {
+                static const ValueType types[] = {V_BOOL, V_BOOL, V_NULL, V_VOID, V_VOID_DEFINE, V_TERMINATE, V_VOID};
+                return types[bits >> 2];
+            }
+            default: return ptr()->v_type;
+        }
+    }
+    bool unset() const { return bits == 0; }
+    bool isFalse() const { return bits == ((S_FALSE << 2) | TAG_SPECIAL); }
+    bool isTailCall() const { return bits == ((S_TAIL_CALL << 2) | TAG_SPECIAL); }
+    int fixnum() const { return (int)((intptr_t)bits >> 2); }   ///< Only valid when type() == V_INT
+    bool identical(const Value &other) const { return bits == other.bits; }
+
+    void show(std::ostream &) const;
+    void showCdr(std::ostream &) const;
+    ValueBase* operator->() const { return ptr(); }
+    ValueBase& operator*() const { return *ptr(); }
+    ValueBase* get() const { return boxed() ? ptr() : nullptr; }
+};
+
+/**
+ * @brief Keeps one Value alive for as long as its holder exists
+ */
+struct RootedValue : GcRoot {
+    Value v;
+    explicit RootedValue(const Value &v) : v(v) {}
+    virtual void trace() override;
 };
 
 // ============================================================================
@@ -65,77 +129,149 @@ struct Assoc {
  * @brief Association list node for variable bindings
  */
 struct AssocList {
-    std::string x;      ///< Variable name
+    Sym x;              ///< Variable name
     Value v;            ///< Variable value
     Assoc next;         ///< Next binding in the chain
-    AssocList(const std::string &, const Value &, Assoc &);
+    AssocList(Sym, const Value &, Assoc &);
 };
 
 // Environment operations
 Assoc empty();
-Assoc extend(const std::string&, const Value &, Assoc &);
-void modify(const std::string&, const Value &, Assoc &);
-Value find(const std::string &, Assoc &);
+Assoc extend(Sym, const Value &, Assoc &);
+void modify(Sym, const Value &, Assoc &);
+Value find(Sym, Assoc &);
 
 // ============================================================================
-// Simple Value Types
+// Global Environment
 // ============================================================================
 
 /**
- * @brief Void value (represents no meaningful return value)
+ * @brief Top-level bindings made by define
+ *
+ * A hash table from name to binding cell. Cells are never removed and keep
+ * their address for the lifetime of the interpreter, so resolved Var and Set
+ * nodes cache the pointer after the first lookup.
+ *
+ * Local environments captured by closures stop at the innermost lambda or let
+ * and never include the globals, so a global defined after a closure was
+ * created is still visible to it.
  */
-struct Void : ValueBase {
-    Void();
-    Void(int i):ValueBase(V_VOID_DEFINE) {
-    }
-    virtual void show(std::ostream &) override;
+Value *findGlobal(Sym);
+Value *defineGlobal(Sym, const Value &);
+
+// ============================================================================
+// Activation Frames
+// ============================================================================
+
+/**
+ * @brief Handle to an activation frame (local environment)
+ *
+ * A null handle is the empty local environment that top-level forms run in.
+ */
+struct Env {
+    Frame *ptr;
+    Env(Frame *f = nullptr) : ptr(f) {}
+    Frame* operator->() const { return ptr; }
+    Frame* get() const { return ptr; }
 };
-Value VoidV();
 
-inline Value VoidD() {
-    return Value(new Void(0));
+/**
+ * @brief Bindings introduced together by one call, let or letrec
+ *
+ * The slots are stored directly after the header in the same allocation, so
+ * entering a procedure costs a single allocation regardless of its arity.
+ * Slot names are not kept; the resolver addresses every local as
+ * (frames to skip, slot index).
+ */
+struct Frame {
+    bool marked;        ///< Set while a collection finds the frame reachable
+    int size;           ///< Number of slots
+    Env parent;         ///< Enclosing frame, null at top level
+    Frame(int, const Env &);
+    Value *slots() { return reinterpret_cast<Value *>(this + 1); }
 };
 
+// Frame operations
+Env makeFrame(int, const Env &);
+Value &locate(int, int, Env &);
+
+// ============================================================================
+// Simple Value Types
+// ============================================================================
+
+/**
+ * @brief Void value (represents no meaningful return value); an immediate
+ *
+ * VoidD is the value of a define, which the REPL does not print.
+ */
+Value VoidV();
+Value VoidD();
+
 /**
- * @brief Integer value
+ * @brief Integer value; an immediate holding a C int
  */
-struct Integer : ValueBase {
-    int n;
-    Integer(int);
+Value IntegerV(int);
+
+/**
+ * @brief Integer outside the range of a fixnum
+ *
+ * Made only through IntegerV(const BigInt &), which returns a fixnum whenever
+ * the value fits, so every integer has exactly one representation.
+ */
+struct BigNum : ValueBase {
+    BigInt n;
+    BigNum(const BigInt &);
     virtual void show(std::ostream &) override;
 };
-Value IntegerV(int);
+Value IntegerV(const BigInt &);
 
 /**
- * @brief Rational number value
+ * @brief Rational number value with 64-bit parts
+ *
+ * The fraction is always in lowest terms with a positive denominator, and
+ * neither part is LLONG_MIN, so either can be negated. A fraction whose parts
+ * do not fit is a BigRational; the RationalV factories pick the
+ * representation, so each rational has exactly one.
  */
 struct Rational : ValueBase {
-    int numerator;
-    int denominator;
-    Rational(int, int);
+    long long numerator;
+    long long denominator;
+    Rational(long long, long long);     ///< Parts must already be reduced
     virtual void show(std::ostream &) override;
 };
-Value RationalV(int, int);
 
 /**
- * @brief Boolean value
+ * @brief Rational number value with a part beyond 64 bits
  */
-struct Boolean : ValueBase {
-    bool b;
-    Boolean(bool);
+struct BigRational : ValueBase {
+    BigInt numerator;
+    BigInt denominator;
+    BigRational(const BigInt &, const BigInt &); ///< Parts must already be reduced
     virtual void show(std::ostream &) override;
 };
+
+// Reduce the fraction and throw on a zero denominator
+Value RationalV(long long, long long);
+Value RationalV(const BigInt &, const BigInt &);
+// For a fraction the caller has already put in lowest terms, positive denominator
+Value ReducedRationalV(long long, long long);
+
+unsigned long long binaryGcd(unsigned long long, unsigned long long);
+
+/**
+ * @brief Boolean value; an immediate
+ */
 Value BooleanV(bool);
 
 /**
  * @brief Symbol value
  */
 struct Symbol : ValueBase {
-    std::string s;
-    Symbol(const std::string &);
+    Sym s;
+    Symbol(Sym);
     virtual void show(std::ostream &) override;
 };
-Value SymbolV(const std::string &);
+Value SymbolV(Sym);
 
 /**
  * @brief String value
@@ -152,30 +288,32 @@ Value StringV(const std::string &);
 // ============================================================================
 
 /**
- * @brief Null value (empty list)
+ * @brief Null value (empty list); an immediate
  */
-struct Null : ValueBase {
-    Null();
-    virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
-};
 Value NullV();
 
 /**
- * @brief Termination signal value
+ * @brief Termination signal value; an immediate
  */
-struct Terminate : ValueBase {
-    Terminate();
-    virtual void show(std::ostream &) override;
-};
 Value TerminateV();
 
+/**
+ * @brief Marker returned by a call in tail position; an immediate
+ *
+ * The call itself is left pending for the nearest enclosing non-tail Apply,
+ * which runs it in a loop instead of nesting. It never reaches Scheme code.
+ */
+Value TailCallV();
+
 // ============================================================================
 // Composite Value Types
 // ============================================================================
 
 /**
  * @brief Pair value (cons cell)
+ *
+ * 32 bytes (vtable, tag and mark, two words), so cons cells fill one of the
+ * collector's slab size classes exactly.
  */
 struct Pair : ValueBase {
     Value car;  ///< First element
@@ -183,25 +321,68 @@ struct Pair : ValueBase {
     Pair(const Value &, const Value &);
     virtual void show(std::ostream &) override;
     virtual void showCdr(std::ostream &) override;
+    virtual void trace() override;
 };
 Value PairV(const Value &, const Value &);
 
 /**
  * @brief Procedure (function) value
+ *
+ * A closure made by the tree walker has parameters and a body e; one made by
+ * the bytecode VM has its compiled body in chunk instead and no parameters.
  */
 struct Procedure : ValueBase {
-    std::vector<std::string> parameters;   ///< Parameter names
+    std::vector<Sym> parameters;           ///< Parameter names
     Expr e;                                ///< Function body expression
-    Assoc env;                             ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
+    Env env;                               ///< Closure environment
+    std::shared_ptr<Chunk> chunk;          ///< Compiled body, set only under the VM
+    std::vector<bool> boxed;               ///< Parameters to box on entry; empty when none are
+    Procedure(const std::vector<Sym> &, const Expr &, const Env &);
+    Procedure(const std::shared_ptr<Chunk> &, const Env &);
+    virtual void show(std::ostream &) override;
+    virtual void trace() override;
+};
+Value ProcedureV(const std::vector<Sym> &, const Expr &, const Env &);
+
+/**
+ * @brief Shared cell for a local that is both captured and assigned
+ *
+ * Closures copy the values of their free variables. When the variable can
+ * change after the copy is made, its slot holds a Box and the copy is of the
+ * box, so the assignment is seen through every closure. Never user-visible.
+ */
+struct Box : ValueBase {
+    Value v;
+    Box(const Value &);
+    virtual void show(std::ostream &) override;
+    virtual void trace() override;
+};
+Value BoxV(const Value &);
+
+/**
+ * @brief Signature of a built-in procedure; args points at argc values
+ */
+typedef Value (*PrimitiveFn)(const Value *args, int argc);
+
+/**
+ * @brief Built-in procedure used as a value, e.g. car passed to a user function
+ *
+ * One instance exists per primitive. Applying it checks the arity and calls
+ * fn directly.
+ */
+struct Primitive : ValueBase {
+    Sym name;
+    PrimitiveFn fn;
+    int min_args;
+    int max_args;                          ///< -1 when there is no upper bound
+    Primitive(Sym, PrimitiveFn, int, int);
     virtual void show(std::ostream &) override;
 };
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
 
 // ============================================================================
 // Utility Functions
 // ============================================================================
 
-std::ostream &operator<<(std::ostream &, Value &);
+std::ostream &operator<<(std::ostream &, const Value &);
 
 #endif // VALUE
\ No newline at end of file
@@ -0,0 +1,330 @@
+/**
+ * @file vm.cpp
+ * @brief The bytecode dispatch loop
+ *
+ * The operand stack and the call stack are local to one execute call, so an
+ * error thrown anywhere in the loop simply unwinds them. A Scheme call pushes
+ * an Activation instead of recursing, which also makes deep non-tail
+ * recursion limited by memory rather than by the native stack.
+ */
+
+#include "vm.hpp"
+#include "RE.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief A suspended caller: where to resume and in which frame
+ */
+struct Activation {
+    Chunk *chunk;
+    const int *pc;
+    Env env;
+    Value proc;         ///< Keeps the caller's closure, and so its chunk, alive
+};
+
+/**
+ * @brief Makes the VM's operand and call stacks roots for the collector
+ */
+struct VmRoots : GcRoot {
+    const std::vector<Value> &stack;
+    const std::vector<Activation> &calls;
+    VmRoots(const std::vector<Value> &stack, const std::vector<Activation> &calls)
+        : stack(stack), calls(calls) {}
+    virtual void trace() override {
+        for (const Value &v : stack) {
+            gcMark(v);
+        }
+        for (const Activation &a : calls) {
+            gcMark(a.env.get());
+            gcMark(a.proc);
+        }
+    }
+};
+
+static Value run(Chunk *top) {
+    std::vector<Value> stack;
+    std::vector<Activation> calls;
+    VmRoots roots(stack, calls);
+    stack.reserve(64);
+
+    Chunk *chunk = top;
+    const int *pc = chunk->code.data();
+    Env env;
+    Value proc(nullptr);
+
+    for (;;) {
+        switch (*pc++) {
+            case OP_CONST:
+                stack.push_back(chunk->consts[*pc++]);
+                break;
+            case OP_EVAL:
+                stack.push_back(chunk->nodes[*pc++]->eval(env));
+                break;
+            case OP_LOCAL: {
+                Value &local = locate(pc[0], pc[1], env);
+                pc += 2;
+                if (local.unset()) {
+                    throw RuntimeError("Variable used before its definition");
+                }
+                stack.push_back(local);
+                break;
+            }
+            case OP_LOCAL_BOXED: {
+                Value &local = static_cast<Box*>(locate(pc[0], pc[1], env).get())->v;
+                pc += 2;
+                if (local.unset()) {
+                    throw RuntimeError("Variable used before its definition");
+                }
+                stack.push_back(local);
+                break;
+            }
+            case OP_GLOBAL: {
+                Var *var = static_cast<Var*>(chunk->nodes[*pc++]);
+                stack.push_back(var->cell != nullptr ? *var->cell : var->eval(env));
+                break;
+            }
+            case OP_STORE_LOCAL:
+                locate(pc[0], pc[1], env) = stack.back();
+                pc += 2;
+                stack.pop_back();
+                break;
+            case OP_STORE_BOXED:
+                static_cast<Box*>(locate(pc[0], pc[1], env).get())->v = stack.back();
+                pc += 2;
+                stack.pop_back();
+                break;
+            case OP_MAKE_BOX: {
+                Value &slot = env->slots()[*pc++];
+                slot = BoxV(slot);
+                break;
+            }
+            case OP_SET_GLOBAL: {
+                Set *set = static_cast<Set*>(chunk->nodes[*pc++]);
+                if (set->cell == nullptr) {
+                    set->cell = findGlobal(set->var);
+                }
+                if (set->cell == nullptr) {
+                    throw RuntimeError("set! on an undefined variable: " + set->var.str());
+                }
+                *set->cell = stack.back();
+                stack.pop_back();
+                break;
+            }
+            case OP_DEFINE_GLOBAL:
+                defineGlobal(static_cast<Define*>(chunk->nodes[*pc++])->var, stack.back());
+                stack.pop_back();
+                break;
+            case OP_POP:
+                stack.pop_back();
+                break;
+            case OP_JUMP:
+                pc = chunk->code.data() + *pc;
+                break;
+            case OP_JUMP_IF_FALSE: {
+                bool is_false = stack.back().isFalse();
+                stack.pop_back();
+                pc = is_false ? chunk->code.data() + *pc : pc + 1;
+                break;
+            }
+            case OP_JUMP_IF_FALSE_KEEP:
+                if (stack.back().isFalse()) {
+                    pc = chunk->code.data() + *pc;
+                } else {
+                    stack.pop_back();
+                    ++pc;
+                }
+                break;
+            case OP_JUMP_IF_TRUE_KEEP:
+                if (!stack.back().isFalse()) {
+                    pc = chunk->code.data() + *pc;
+                } else {
+                    stack.pop_back();
+                    ++pc;
+                }
+                break;
+            case OP_ENTER: {
+                int n = *pc++;
+                Env frame = makeFrame(n, env);
+                size_t base = stack.size() - n;
+                for (int i = 0; i < n; ++i) {
+                    frame->slots()[i] = stack[base + i];
+                }
+                stack.resize(base, Value(nullptr));
+                env = frame;
+                break;
+            }
+            case OP_ENTER_EMPTY:
+                env = makeFrame(*pc++, env);
+                break;
+            case OP_LEAVE: {
+                Env parent = env->parent;
+                env = parent;
+                break;
+            }
+            case OP_CLOSURE: {
+                const std::shared_ptr<Chunk> &body = chunk->lambdas[*pc++];
+                Env closure;
+                if (!body->captures.empty()) {
+                    closure = makeFrame(body->captures.size(), Env());
+                    for (size_t i = 0; i < body->captures.size(); ++i) {
+                        closure->slots()[i] = locate(body->captures[i].first, body->captures[i].second, env);
+                    }
+                }
+                stack.push_back(Value(new Procedure(body, closure)));
+                break;
+            }
+            case OP_CALL:
+            case OP_TAIL_CALL: {
+                bool tail = pc[-1] == OP_TAIL_CALL;
+                int argc = *pc++;
+                size_t base = stack.size() - argc;
+                Value callee = stack[base - 1];
+
+                if (callee.type() == V_PRIMITIVE) {
+                    ++runtime_stats.first_class_primitive_calls;
+                    Primitive *prim = static_cast<Primitive*>(callee.get());
+                    if (argc < prim->min_args || (prim->max_args >= 0 && argc > prim->max_args)) {
+                        throw RuntimeError("Wrong number of arguments");
+                    }
+                    Value result = prim->fn(stack.data() + base, argc);
+                    stack.resize(base - 1, Value(nullptr));
+                    stack.push_back(result);
+                    if (tail) {
+                        goto do_return;
+                    }
+                    break;
+                }
+                if (callee.type() != V_PROC) {
+                    throw RuntimeError("Attempt to apply a non-procedure");
+                }
+                Procedure *clos = static_cast<Procedure*>(callee.get());
+                ++runtime_stats.procedure_calls;
+                if (argc != clos->chunk->arity) {
+                    throw RuntimeError("Wrong number of arguments");
+                }
+
+                Env frame = makeFrame(argc, clos->env);
+                for (int i = 0; i < argc; ++i) {
+                    frame->slots()[i] = stack[base + i];
+                }
+                stack.resize(base - 1, Value(nullptr));
+                if (tail) {
+                    ++runtime_stats.tail_calls;
+                } else {
+                    calls.push_back(Activation{chunk, pc, env, proc});
+                }
+                chunk = clos->chunk.get();
+                pc = chunk->code.data();
+                env = frame;
+                proc = callee;
+                break;
+            }
+            case OP_RETURN:
+            do_return: {
+                if (calls.empty()) {
+                    return stack.back();
+                }
+                Activation &caller = calls.back();
+                chunk = caller.chunk;
+                pc = caller.pc;
+                env = caller.env;
+                proc = caller.proc;
+                calls.pop_back();
+                break;
+            }
+            case OP_PRIM1: {
+                Unary *node = static_cast<Unary*>(chunk->nodes[*pc++]);
+                stack.back() = node->evalRator(stack.back());
+                break;
+            }
+            case OP_PRIM2: {
+                Binary *node = static_cast<Binary*>(chunk->nodes[*pc++]);
+                Value result = node->evalRator(stack[stack.size() - 2], stack.back());
+                stack.pop_back();
+                stack.back() = result;
+                break;
+            }
+            case OP_PRIMN: {
+                Variadic *node = static_cast<Variadic*>(chunk->nodes[pc[0]]);
+                int argc = pc[1];
+                pc += 2;
+                std::vector<Value> args(stack.end() - argc, stack.end());
+                RootedValues rooted(args);
+                Value result = node->evalRator(args);
+                stack.resize(stack.size() - argc, Value(nullptr));
+                stack.push_back(result);
+                break;
+            }
+            case OP_CONS: {
+                Value result = PairV(stack[stack.size() - 2], stack.back());
+                stack.pop_back();
+                stack.back() = result;
+                break;
+            }
+
+// Fixnum operands are handled inline, arithmetic only when the result fits;
+// anything else goes through the node's evalRator
+#define FIXNUM_ARITH(OP, BUILTIN)                                                \
+            case OP: {                                                           \
+                Value &a = stack[stack.size() - 2];                              \
+                Value &b = stack.back();                                         \
+                int n;                                                           \
+                Value result = (a.type() == V_INT && b.type() == V_INT &&        \
+                                !BUILTIN(a.fixnum(), b.fixnum(), &n))            \
+                    ? IntegerV(n)                                                \
+                    : static_cast<Binary*>(chunk->nodes[*pc])->evalRator(a, b);  \
+                ++pc;                                                            \
+                stack.pop_back();                                                \
+                stack.back() = result;                                           \
+                break;                                                           \
+            }
+#define FIXNUM_BINARY(OP, EXPR)                                                  \
+            case OP: {                                                           \
+                Value &a = stack[stack.size() - 2];                              \
+                Value &b = stack.back();                                         \
+                Value result = (a.type() == V_INT && b.type() == V_INT)          \
+                    ? (EXPR)                                                     \
+                    : static_cast<Binary*>(chunk->nodes[*pc])->evalRator(a, b);  \
+                ++pc;                                                            \
+                stack.pop_back();                                                \
+                stack.back() = result;                                           \
+                break;                                                           \
+            }
+            FIXNUM_ARITH(OP_ADD, __builtin_add_overflow)
+            FIXNUM_ARITH(OP_SUB, __builtin_sub_overflow)
+            FIXNUM_ARITH(OP_MUL, __builtin_mul_overflow)
+            FIXNUM_BINARY(OP_LT, BooleanV(a.fixnum() < b.fixnum()))
+            FIXNUM_BINARY(OP_LE, BooleanV(a.fixnum() <= b.fixnum()))
+            FIXNUM_BINARY(OP_NUM_EQ, BooleanV(a.fixnum() == b.fixnum()))
+            FIXNUM_BINARY(OP_GE, BooleanV(a.fixnum() >= b.fixnum()))
+            FIXNUM_BINARY(OP_GT, BooleanV(a.fixnum() > b.fixnum()))
+#undef FIXNUM_ARITH
+#undef FIXNUM_BINARY
+
+            case OP_CAR:
+            case OP_CDR: {
+                bool is_car = pc[-1] == OP_CAR;
+                Value &top = stack.back();
+                if (top.type() == V_PAIR) {
+                    Pair *p = static_cast<Pair*>(top.get());
+                    Value field = is_car ? p->car : p->cdr; // copied first: the pair may die with top
+                    top = field;
+                } else {
+                    top = static_cast<Unary*>(chunk->nodes[*pc])->evalRator(top);
+                }
+                ++pc;
+                break;
+            }
+            default:
+                throw RuntimeError("Invalid bytecode");
+        }
+    }
+}
+
+Value execute(Expr &expr) {
+    std::shared_ptr<Chunk> top = std::make_shared<Chunk>(0);
+    Compiler c(top.get());
+    expr->compile(c);
+    c.emit(OP_RETURN);
+    return run(top.get());
+}
@@ -0,0 +1,103 @@
+#ifndef VM
+#define VM
+
+/**
+ * @file vm.hpp
+ * @brief Bytecode compiler and stack machine, an alternative to the tree walker
+ *
+ * A resolved top-level expression is compiled into a Chunk: a flat array of
+ * opcodes and int operands. Every lambda body inside it becomes a Chunk of its
+ * own. The VM runs chunks in one dispatch loop with an explicit operand stack
+ * and call stack, so neither Scheme calls nor subexpressions nest C++ frames.
+ *
+ * Local variables use the same Frame layout and (depth, index) addresses as
+ * the tree walker. Primitive nodes keep their evalRator; the VM calls it on
+ * operands taken from its stack, with fixnum fast paths for the common ones.
+ * Nodes that have no compile method of their own are run by the tree walker
+ * through OP_EVAL.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Instruction set; operands follow the opcode in the code array
+ */
+enum Opcode {
+    OP_CONST,          ///< k: push consts[k]
+    OP_EVAL,           ///< n: push nodes[n]->eval(env)
+    OP_LOCAL,          ///< depth index: push a local, which must be set
+    OP_LOCAL_BOXED,    ///< depth index: push the contents of a boxed local
+    OP_GLOBAL,         ///< n: push the global read by Var nodes[n]
+    OP_STORE_LOCAL,    ///< depth index: pop into a local
+    OP_STORE_BOXED,    ///< depth index: pop into the box of a local
+    OP_MAKE_BOX,       ///< index: wrap a slot of the current frame in a Box
+    OP_SET_GLOBAL,     ///< n: pop into the global assigned by Set nodes[n]
+    OP_DEFINE_GLOBAL,  ///< n: pop into the global defined by Define nodes[n]
+    OP_POP,            ///< discard the top
+    OP_JUMP,           ///< target
+    OP_JUMP_IF_FALSE,  ///< target: pop, jump if it was #f
+    OP_JUMP_IF_FALSE_KEEP, ///< target: jump if the top is #f, otherwise pop it
+    OP_JUMP_IF_TRUE_KEEP,  ///< target: jump if the top is not #f, otherwise pop it
+    OP_ENTER,          ///< n: new frame whose slots are the top n values
+    OP_ENTER_EMPTY,    ///< n: new frame of n unset slots
+    OP_LEAVE,          ///< return to the parent frame
+    OP_CLOSURE,        ///< k: push a procedure for lambdas[k], copying its captures
+    OP_CALL,           ///< argc: call the procedure below the top argc values
+    OP_TAIL_CALL,      ///< argc: as OP_CALL, replacing the current activation
+    OP_RETURN,         ///< leave the activation with the top as its value
+    OP_PRIM1,          ///< n: apply Unary nodes[n] to the top
+    OP_PRIM2,          ///< n: apply Binary nodes[n] to the top two
+    OP_PRIMN,          ///< n argc: apply Variadic nodes[n] to the top argc
+    OP_ADD,            ///< n: fixnum +, otherwise Binary nodes[n]
+    OP_SUB,            ///< n: fixnum -
+    OP_MUL,            ///< n: fixnum *
+    OP_LT,             ///< n: fixnum <
+    OP_LE,             ///< n: fixnum <=
+    OP_NUM_EQ,         ///< n: fixnum =
+    OP_GE,             ///< n: fixnum >=
+    OP_GT,             ///< n: fixnum >
+    OP_CAR,            ///< n: car of a pair, otherwise Unary nodes[n]
+    OP_CDR,            ///< n: cdr of a pair
+    OP_CONS            ///< cons the top two
+};
+
+/**
+ * @brief Compiled code of one top-level form or one lambda body
+ *
+ * The nodes a chunk refers to live in the form's arena, which is retained
+ * whenever the form contains a lambda, so they outlive any closure over it.
+ */
+struct Chunk {
+    std::vector<int> code;
+    std::vector<Value> consts;     ///< Immediates, or heap values rooted by the node they came from
+    std::vector<ExprBase *> nodes;
+    std::vector<std::shared_ptr<Chunk>> lambdas;
+    int arity;          ///< Parameter count of a lambda body, 0 for a top-level form
+    std::vector<std::pair<int, int>> captures; ///< Lambda::captures of the body's lambda
+    explicit Chunk(int);
+};
+
+/**
+ * @brief Emits code into one chunk; each compile method appends its node's code
+ */
+struct Compiler {
+    Chunk *chunk;
+    explicit Compiler(Chunk *);
+
+    void emit(int);
+    int here() const;
+    void patch(int, int);                  ///< Sets the jump operand at an offset to a target
+    int constant(const Value &);
+    int node(ExprBase *);
+};
+
+/**
+ * @brief Compiles and runs a resolved top-level expression on the VM
+ */
+Value execute(Expr &);
+
+#endif